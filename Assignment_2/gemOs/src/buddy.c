@@ -0,0 +1,153 @@
+#include<types.h>
+#include<lib.h>
+#include<memory.h>
+
+/*
+ * Buddy allocator for the file system regions (FILE_DS_REG and
+ * FILE_STORE_REG). Blocks of 2^order pages, order 0 .. BUDDY_MAX_ORDER,
+ * are aligned to their size in pfn space, so the buddy of a block is
+ * found by flipping bit "order" of its pfn.
+ *
+ * Free blocks are kept on per-order doubly linked lists threaded through
+ * the first bytes of the free pages themselves. page_order[] has one byte
+ * per page of the region: BUDDY_FREE|order for the first page of a free
+ * block, 0 otherwise.
+ *
+ * memory.o keeps the page_list bitmap of every region in its first pages.
+ * Those pages, and the pages holding page_order[], are never handed out.
+ */
+
+#define BUDDY_FREE 0x80
+
+struct buddy_block{
+	u32 next;   // pfn of the next free block of this order, 0 = none
+	u32 prev;
+};
+
+static struct buddy_zone buddy_zones[MAX_REG];
+
+static struct buddy_zone *get_zone(u32 region)
+{
+	if(region >= MAX_REG || !buddy_zones[region].num_pages)
+		return NULL;
+	return &buddy_zones[region];
+}
+
+static inline struct buddy_block *block_of(u32 pfn)
+{
+	return (struct buddy_block *)osmap(pfn);
+}
+
+static void list_add(struct buddy_zone *zone, u32 pfn, u32 order)
+{
+	struct buddy_block *block = block_of(pfn);
+	block->prev = 0;
+	block->next = zone->free_head[order];
+	if(block->next)
+		block_of(block->next)->prev = pfn;
+	zone->free_head[order] = pfn;
+	zone->page_order[pfn - zone->start_pfn] = BUDDY_FREE | order;
+}
+
+static void list_del(struct buddy_zone *zone, u32 pfn, u32 order)
+{
+	struct buddy_block *block = block_of(pfn);
+	if(block->prev)
+		block_of(block->prev)->next = block->next;
+	else
+		zone->free_head[order] = block->next;
+	if(block->next)
+		block_of(block->next)->prev = block->prev;
+	zone->page_order[pfn - zone->start_pfn] = 0;
+}
+
+void buddy_init(u32 region, u64 start, u64 end)
+{
+	struct buddy_zone *zone = &buddy_zones[region];
+	u32 pfn, end_pfn, order, reserved;
+	u32 bitmap_bytes, map_pages;
+
+	zone->start_pfn = start >> PAGE_SHIFT;
+	zone->num_pages = (end - start) >> PAGE_SHIFT;
+	zone->free_pages = 0;
+	for(order = 0; order <= BUDDY_MAX_ORDER; order++)
+		zone->free_head[order] = 0;
+
+	/* page_list bitmap of memory.o, followed by our page_order[] */
+	bitmap_bytes = zone->num_pages >> 3;
+	reserved = (bitmap_bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+	map_pages = (zone->num_pages + PAGE_SIZE - 1) / PAGE_SIZE;
+	zone->page_order = (u8 *)osmap(zone->start_pfn + reserved);
+	bzero((char *)zone->page_order, map_pages * PAGE_SIZE);
+	reserved += map_pages;
+
+	pfn = zone->start_pfn + reserved;
+	end_pfn = zone->start_pfn + zone->num_pages;
+	while(pfn < end_pfn){
+		order = BUDDY_MAX_ORDER;
+		while((pfn & ((1 << order) - 1)) || pfn + (1 << order) > end_pfn)
+			order--;
+		list_add(zone, pfn, order);
+		zone->free_pages += 1 << order;
+		pfn += 1 << order;
+	}
+}
+
+/* Returns the first pfn of 2^order contiguous pages, 0 on failure */
+u32 buddy_alloc(u32 region, u32 order)
+{
+	struct buddy_zone *zone = get_zone(region);
+	u32 pfn, current;
+
+	if(!zone || order > BUDDY_MAX_ORDER)
+		return 0;
+	for(current = order; current <= BUDDY_MAX_ORDER; current++)
+		if(zone->free_head[current])
+			break;
+	if(current > BUDDY_MAX_ORDER){
+		printk("buddy: region %d out of order-%d blocks\n", region, order);
+		return 0;
+	}
+	pfn = zone->free_head[current];
+	list_del(zone, pfn, current);
+	/* Split, giving the upper halves back */
+	while(current > order){
+		current--;
+		list_add(zone, pfn + (1 << current), current);
+	}
+	zone->free_pages -= 1 << order;
+	return pfn;
+}
+
+void buddy_free(u32 region, u32 pfn, u32 order)
+{
+	struct buddy_zone *zone = get_zone(region);
+	u32 buddy, end_pfn;
+
+	if(!zone || order > BUDDY_MAX_ORDER)
+		return;
+	end_pfn = zone->start_pfn + zone->num_pages;
+	if(pfn < zone->start_pfn || pfn >= end_pfn){
+		printk("buddy: freeing pfn %x outside region %d\n", pfn, region);
+		return;
+	}
+	zone->free_pages += 1 << order;
+	while(order < BUDDY_MAX_ORDER){
+		buddy = pfn ^ (1 << order);
+		if(buddy < zone->start_pfn || buddy >= end_pfn)
+			break;
+		if(zone->page_order[buddy - zone->start_pfn] != (BUDDY_FREE | order))
+			break;
+		list_del(zone, buddy, order);
+		if(buddy < pfn)
+			pfn = buddy;
+		order++;
+	}
+	list_add(zone, pfn, order);
+}
+
+u32 buddy_free_pages(u32 region)
+{
+	struct buddy_zone *zone = get_zone(region);
+	return zone ? zone->free_pages : 0;
+}
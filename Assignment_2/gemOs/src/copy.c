@@ -0,0 +1,53 @@
+#include<types.h>
+#include<lib.h>
+
+/*
+ * Kernel copy routine, memcpy in lib.h maps to it for all the code built
+ * from this tree (the prebuilt objects keep the lib.o one). Large spans go through
+ * rep movsq (plus rep movsb for the tail). Smaller ones align the
+ * destination to 8 bytes and then copy a word at a time.
+ */
+#define REP_MOVS_THRESHOLD 256
+
+static inline void rep_movsq(char **dest, char **src, u64 words)
+{
+	asm volatile(
+		"rep movsq"
+		: "+D" (*dest), "+S" (*src), "+c" (words)
+		:
+		: "memory"
+	);
+}
+
+static inline void rep_movsb(char **dest, char **src, u64 bytes)
+{
+	asm volatile(
+		"rep movsb"
+		: "+D" (*dest), "+S" (*src), "+c" (bytes)
+		:
+		: "memory"
+	);
+}
+
+void fast_memcpy(char *dest, char *src, u32 size)
+{
+	if(size >= REP_MOVS_THRESHOLD){
+		rep_movsq(&dest, &src, size >> 3);
+		rep_movsb(&dest, &src, size & 7);
+		return;
+	}
+	while(size && ((u64)dest & 7)){
+		*dest++ = *src++;
+		size--;
+	}
+	while(size >= 8){
+		*(u64 *)dest = *(u64 *)src;
+		dest += 8;
+		src += 8;
+		size -= 8;
+	}
+	while(size){
+		*dest++ = *src++;
+		size--;
+	}
+}
@@ -11,6 +11,10 @@
 #include<page.h>
 #include<mmap.h>
 #include<msg_queue.h>
+#include<tty.h>
+
+static struct io_ring *io_rings[MAX_PROCESSES];   // by pid, see do_io_setup
+static int io_flags[MAX_PROCESSES];
 
 long do_fork()
 {
@@ -22,6 +26,9 @@ long do_fork()
 	new_ctx->pid = pid;
 	new_ctx->ppid = ctx->pid; 
 	copy_mm(new_ctx, ctx);
+	do_file_fork(new_ctx, ctx);
+	io_rings[pid] = NULL;   // the child calls io_setup for its own copy
+	do_file_mmap_fork(new_ctx, ctx);
 	setup_child_context(new_ctx);
 	
 	// call the message queue handler
@@ -43,6 +50,8 @@ void do_exit()
 	vfork_exit_handle(ctx);
 #endif
 	do_msg_queue_cleanup(ctx);
+	io_rings[ctx->pid] = NULL;
+	do_file_mmap_exit(ctx);
 	do_file_exit(ctx);   // Cleanup the files
 
 	// cleanup of this process
@@ -94,7 +103,7 @@ int do_file_open(struct exec_context *ctx,u64 filename, u64 flag, u64 mode)
 /*system call handler to read file */
 int do_file_read(struct exec_context *ctx, u64 fd, u64 buff, u64 count){
 	int read_size = 0;
-	struct file *filep = ctx->files[fd];
+	struct file *filep = get_file(ctx, fd);
 	dprintk("fd in read:%d\n",fd);
 
 
@@ -118,7 +127,7 @@ int do_file_read(struct exec_context *ctx, u64 fd, u64 buff, u64 count){
 /*system call handler to write file */
 int do_file_write(struct exec_context *ctx,u64 fd,u64 buff,u64 count){
 	int write_size;
-	struct file *filep = ctx->files[fd];
+	struct file *filep = get_file(ctx, fd);
 	if(!filep){
 		return -EINVAL; //file is not opened
 	}
@@ -133,10 +142,86 @@ int do_file_write(struct exec_context *ctx,u64 fd,u64 buff,u64 count){
 	return -EINVAL;
 }
 
+/*
+ * readv/writev: one trap for a list of buffers. The segments go through
+ * the file's fops in order; a short or failed segment ends the call and
+ * the bytes moved so far are returned.
+ */
+static long do_file_iov(struct file *filep, struct iovec *iov, int iovcnt, int write)
+{
+	long total = 0;
+	int i, ret;
+	for(i = 0; i < iovcnt; i++){
+		if(!iov[i].iov_len)
+			continue;
+		if(write)
+			ret = filep->fops->write(filep, (char *)iov[i].iov_base, iov[i].iov_len);
+		else
+			ret = filep->fops->read(filep, (char *)iov[i].iov_base, iov[i].iov_len);
+		if(ret < 0)
+			return total ? total : ret;
+		total += ret;
+		if(ret < iov[i].iov_len)
+			break;
+	}
+	return total;
+}
+
+long do_file_readv(struct exec_context *ctx, u64 fd, u64 iov, u64 iovcnt)
+{
+	struct file *filep;
+	if(!iov || iovcnt > MAX_IOVEC)
+		return -EINVAL;
+	filep = get_file(ctx, fd);
+	if(!filep){
+		return -EINVAL; //file is not opened
+	}
+	if((filep->mode & O_READ) != O_READ){
+		return -EACCES; //file is write only
+	}
+	if(!filep->fops->read)
+		return -EINVAL;
+	return do_file_iov(filep, (struct iovec *)iov, iovcnt, 0);
+}
+
+long do_file_writev(struct exec_context *ctx, u64 fd, u64 iov, u64 iovcnt)
+{
+	struct file *filep;
+	if(!iov || iovcnt > MAX_IOVEC)
+		return -EINVAL;
+	filep = get_file(ctx, fd);
+	if(!filep){
+		return -EINVAL; //file is not opened
+	}
+	if(!(filep->mode & O_WRITE)){
+		return -EACCES; // file is not opened in write mode
+	}
+	if(!filep->fops->write)
+		return -EINVAL;
+	return do_file_iov(filep, (struct iovec *)iov, iovcnt, 1);
+}
+
+/* pread/pwrite: regular files only, the file offset is left alone */
+int do_file_pread(struct exec_context *ctx, u64 fd, u64 buff, u64 count, u64 offset)
+{
+	struct file *filep = get_file(ctx, fd);
+	if(!filep)
+		return -EINVAL; //file is not opened
+	return do_pread_regular(filep, (char *)buff, count, offset);
+}
+
+int do_file_pwrite(struct exec_context *ctx, u64 fd, u64 buff, u64 count, u64 offset)
+{
+	struct file *filep = get_file(ctx, fd);
+	if(!filep)
+		return -EINVAL; //file is not opened
+	return do_pwrite_regular(filep, (char *)buff, count, offset);
+}
+
 /*system call handler to create pipe */
 int do_create_pipe(struct exec_context *ctx, int* fd)
 {
-	int val =  create_pipe(ctx, fd);
+	int val =  open_pipe(ctx, fd);
 	return val;
 }
 
@@ -149,17 +234,18 @@ int do_dup2(struct exec_context *ctx, int oldfd, int newfd)
 int do_close(struct exec_context *ctx, int fd)
 {
 	int ret;
-	struct file *filep = ctx->files[fd];
+	struct file *filep = get_file(ctx, fd);
 	if(!filep || !filep->fops || !filep->fops->close){
 		return -EINVAL; //file is not opened
 	}
-	ctx->files[fd] = NULL;
+	install_fd(ctx, fd, NULL);
 	ret = filep->fops->close(filep);
+	return ret;
 }
 
 long do_lseek(struct exec_context *ctx, int fd, long offset, int whence)
 {
-	struct file *filep = ctx->files[fd];
+	struct file *filep = get_file(ctx, fd);
 	if(filep && filep->fops->lseek)
 	{
 		return filep->fops->lseek(filep, offset, whence);
@@ -168,7 +254,7 @@ long do_lseek(struct exec_context *ctx, int fd, long offset, int whence)
 }
 
 int do_get_member_info(struct exec_context *ctx, u64 fd, u64 info){
-	struct file *filep = ctx->files[fd];
+	struct file *filep = get_file(ctx, fd);
 	if(!filep){
 		return -EINVAL; //file is not opened
 	}
@@ -177,7 +263,7 @@ int do_get_member_info(struct exec_context *ctx, u64 fd, u64 info){
 
 int call_msg_queue_send(struct exec_context *ctx, u64 fd, u64 msg)
 {
-	struct file *filep = ctx->files[fd];
+	struct file *filep = get_file(ctx, fd);
 	if(!filep){
 		return -EINVAL; //file is not opened
 	}
@@ -186,7 +272,7 @@ int call_msg_queue_send(struct exec_context *ctx, u64 fd, u64 msg)
 
 int call_msg_queue_rcv(struct exec_context *ctx, u64 fd, u64 msg)
 {
-	struct file *filep = ctx->files[fd];
+	struct file *filep = get_file(ctx, fd);
 	if(!filep){
 		return -EINVAL; //file is not opened
 	}
@@ -195,7 +281,7 @@ int call_msg_queue_rcv(struct exec_context *ctx, u64 fd, u64 msg)
 
 int call_get_msg_count(struct exec_context *ctx, u64 fd)
 {
-	struct file *filep = ctx->files[fd];
+	struct file *filep = get_file(ctx, fd);
 	if(!filep){
 		return -EINVAL; //file is not opened
 	}
@@ -204,7 +290,7 @@ int call_get_msg_count(struct exec_context *ctx, u64 fd)
 
 int call_msg_queue_block(struct exec_context *ctx, u64 fd, u64 pid)
 {
-	struct file *filep = ctx->files[fd];
+	struct file *filep = get_file(ctx, fd);
 	int block_pid = pid;
 	if(!filep){
 		return -EINVAL; //file is not opened
@@ -222,6 +308,129 @@ int call_sendfile(struct exec_context *ctx, u64 outfd, u64 infd, u64 offset, u64
 	return do_sendfile(ctx, outfd, infd, (long *)offset, count);
 }
 
+int call_getdents(struct exec_context *ctx, u64 buf, u64 count, u64 cookie)
+{
+	return do_getdents(ctx, (void *)buf, count, (u32 *)cookie);
+}
+
+int call_fclone(struct exec_context *ctx, u64 src, u64 dst)
+{
+	return do_fclone(ctx, (char *)src, (char *)dst);
+}
+
+/*
+ * io ring: io_setup registers a struct io_ring in the memory of the
+ * process, io_enter then runs the queued operations through the same
+ * handlers as the system calls, so a batch of small I/O costs one trap
+ * instead of one per operation, or none with IO_SETUP_TICK (see
+ * __wrap_handle_timer_tick). The ring has to be mapped already, and
+ * stay mapped: io_enter checks it again since the process may munmap it.
+ */
+
+static int io_ring_mapped(struct exec_context *ctx, u64 ring)
+{
+	u64 addr, *pte;
+	for(addr = ring & ~(PAGE_SIZE - 1); addr < ring + sizeof(struct io_ring); addr += PAGE_SIZE){
+		pte = get_user_pte(ctx, addr, 0);
+		if(!pte || !(*pte & 1))
+			return 0;
+	}
+	return 1;
+}
+
+int do_io_setup(struct exec_context *ctx, u64 ring, int flags)
+{
+	struct io_ring *r = (struct io_ring *)ring;
+	if(!ring || (ring & 7) || (flags & ~IO_SETUP_TICK) || !io_ring_mapped(ctx, ring))
+		return -EINVAL;
+	r->sq_head = r->sq_tail = 0;
+	r->cq_head = r->cq_tail = 0;
+	io_rings[ctx->pid] = r;
+	io_flags[ctx->pid] = flags;
+	return 0;
+}
+
+static long io_dispatch(struct exec_context *ctx, struct io_sqe *sqe)
+{
+	switch(sqe->opcode)
+	{
+	case IO_OP_NOP:
+		return 0;
+	case IO_OP_READ:
+		return do_file_read(ctx, sqe->fd, sqe->addr, sqe->len);
+	case IO_OP_WRITE:
+		return do_file_write(ctx, sqe->fd, sqe->addr, sqe->len);
+	case IO_OP_LSEEK:
+		return do_lseek(ctx, sqe->fd, sqe->off, sqe->len);
+	case IO_OP_OPEN:
+		return do_file_open(ctx, sqe->addr, sqe->len, sqe->off);
+	case IO_OP_CLOSE:
+		return do_close(ctx, sqe->fd);
+	case IO_OP_PREAD:
+		return do_file_pread(ctx, sqe->fd, sqe->addr, sqe->len, sqe->off);
+	case IO_OP_PWRITE:
+		return do_file_pwrite(ctx, sqe->fd, sqe->addr, sqe->len, sqe->off);
+	case IO_OP_MSG_SEND:
+		return call_msg_queue_send(ctx, sqe->fd, sqe->addr);
+	case IO_OP_MSG_RCV:
+		return call_msg_queue_rcv(ctx, sqe->fd, sqe->addr);
+	}
+	return -EINVAL;
+}
+
+/*
+ * Runs up to count queued operations (all of them if count <= 0), stopping
+ * early when the completion ring is full. Returns the number run.
+ */
+int do_io_enter(struct exec_context *ctx, int count)
+{
+	struct io_ring *ring = io_rings[ctx->pid];
+	struct io_sqe *sqe;
+	struct io_cqe *cqe;
+	int done = 0;
+
+	if(!ring)
+		return -EINVAL;
+	if(!io_ring_mapped(ctx, (u64)ring)){
+		io_rings[ctx->pid] = NULL;
+		return -EINVAL;
+	}
+	if(ring->sq_tail - ring->sq_head > IO_RING_ENTRIES)
+		return -EINVAL;
+	while(ring->sq_head != ring->sq_tail && (count <= 0 || done < count)){
+		if(ring->cq_tail - ring->cq_head >= IO_RING_ENTRIES)
+			break;
+		sqe = &ring->sqes[ring->sq_head % IO_RING_ENTRIES];
+		cqe = &ring->cqes[ring->cq_tail % IO_RING_ENTRIES];
+		cqe->user_data = sqe->user_data;
+		cqe->res = io_dispatch(ctx, sqe);
+		ring->sq_head++;
+		ring->cq_tail++;
+		done++;
+	}
+	return done;
+}
+
+/*
+ * do_irq in the prebuilt apic.o calls handle_timer_tick for every tick;
+ * the kernel is linked with --wrap=handle_timer_tick (see the Makefile)
+ * so the call lands here first. The console tty is fed from here, having
+ * no IRQ of its own. If the tick interrupted a process in user mode and
+ * its ring was set up with IO_SETUP_TICK, the queued operations run now,
+ * on the process's own page tables, as an io_enter would run them.
+ */
+extern int __real_handle_timer_tick(struct user_regs *regs);
+
+int __wrap_handle_timer_tick(struct user_regs *regs)
+{
+	struct exec_context *ctx = get_current_ctx();
+
+	tty_tick();
+	if((regs->entry_cs & 3) == 3 && io_rings[ctx->pid] && (io_flags[ctx->pid] & IO_SETUP_TICK))
+		do_io_enter(ctx, 0);
+	return __real_handle_timer_tick(regs);
+}
+
 /*System Call handler*/
 long  do_syscall(int syscall, u64 param1, u64 param2, u64 param3, u64 param4)
 {
@@ -295,7 +504,18 @@ long  do_syscall(int syscall, u64 param1, u64 param2, u64 param3, u64 param4)
 		return (long) vm_area_map(current, param1, param2, param3, param4);
 
 	case SYSCALL_MUNMAP:
+		do_file_munmap(current, param1, param2);
 		return (u64) vm_area_unmap(current, param1, param2);
+	case SYSCALL_MMAP_FILE:
+		return do_mmap_file(current, param1, param2, param3, param4);
+	case SYSCALL_SPLICE:
+		return do_splice(current, param1, param2, param3);
+	case SYSCALL_TEE:
+		return do_tee(current, param1, param2, param3);
+	case SYSCALL_IO_SETUP:
+		return do_io_setup(current, param1, param2);
+	case SYSCALL_IO_ENTER:
+		return do_io_enter(current, param1);
 	case SYSCALL_MPROTECT:
 		return (long) vm_area_mprotect(current, param1, param2, param3);
 	case SYSCALL_PMAP:
@@ -303,9 +523,19 @@ long  do_syscall(int syscall, u64 param1, u64 param2, u64 param3, u64 param4)
 	case SYSCALL_OPEN:
 		return do_file_open(current,param1,param2,param3);
 	case SYSCALL_READ:
+		file_wait(current, param1, param3, 0);
 		return do_file_read(current,param1,param2,param3);
 	case SYSCALL_WRITE:
+		file_wait(current, param1, param3, 1);
 		return do_file_write(current,param1,param2,param3);
+	case SYSCALL_READV:
+		return do_file_readv(current, param1, param2, param3);
+	case SYSCALL_WRITEV:
+		return do_file_writev(current, param1, param2, param3);
+	case SYSCALL_PREAD:
+		return do_file_pread(current, param1, param2, param3, param4);
+	case SYSCALL_PWRITE:
+		return do_file_pwrite(current, param1, param2, param3, param4);
 	case SYSCALL_PIPE:
 		return do_create_pipe(current, (void*) param1);
 
@@ -334,6 +564,16 @@ long  do_syscall(int syscall, u64 param1, u64 param2, u64 param3, u64 param4)
 		return call_msg_queue_close(current, param1);
 	case SYSCALL_SENDFILE:
 		return call_sendfile(current, param1, param2, param3, param4);
+	case SYSCALL_GETDENTS:
+		return call_getdents(current, param1, param2, param3);
+	case SYSCALL_FCLONE:
+		return call_fclone(current, param1, param2);
+	case SYSCALL_FDEDUP:
+		return do_fdedup(current, param1);
+	case SYSCALL_FCOMPRESS:
+		return do_fcompress(current, param1, (struct fcompress_stats *)param2);
+	case SYSCALL_FSSTATS:
+		return do_fsstats(current, (struct fs_stats *)param1, (struct inode_stats *)param2, param3, (u32 *)param4);
 	default:
 		return -1;
 	}
@@ -6,31 +6,72 @@
 #include<entry.h>
 #include<memory.h>
 #include<fs.h>
-#include<kbd.h>
+#include<tty.h>
+#include<mmap.h>
+#include<pipe.h>
+#include<wait.h>
 
 
 /************************************************************************************/
 /***************************Do Not Modify below Functions****************************/
 /************************************************************************************/
 
+/*
+ * struct file cache. File objects are cut out of OS_DS_REG pages, many
+ * to a page, and freed objects go on a list threaded through them. The
+ * pages stay with the cache, so open and close only reach the page
+ * allocator while the cache grows. Every object has room for private
+ * fops, filled in by create_pipe; regular files, pipes (see open_pipe)
+ * and the standard IO files point at shared tables instead.
+ */
+struct file_slot{
+	struct file file;
+	struct fileops fops;
+};
+
+#define FILE_SLOTS_PER_PAGE (PAGE_SIZE / sizeof(struct file_slot))
+
+static struct file_slot *free_file_slots;
+
+static struct file_slot *alloc_file_slot(void)
+{
+	struct file_slot *slot;
+	int i;
+	if(!free_file_slots){
+		slot = (struct file_slot *) os_page_alloc(OS_DS_REG);
+		if(!slot)
+			return NULL;
+		for(i = 0; i < FILE_SLOTS_PER_PAGE; i++){
+			*(struct file_slot **)&slot[i] = free_file_slots;
+			free_file_slots = &slot[i];
+		}
+	}
+	slot = free_file_slots;
+	free_file_slots = *(struct file_slot **)slot;
+	return slot;
+}
+
 void free_file_object(struct file *filep)
 {
+	struct file_slot *slot = (struct file_slot *)filep;
 	if(filep)
 	{
-		os_page_free(OS_DS_REG ,filep);
+		*(struct file_slot **)slot = free_file_slots;
+		free_file_slots = slot;
 		stats->file_objects--;
 	}
 }
 
 struct file *alloc_file()
 {
-	struct file *file = (struct file *) os_page_alloc(OS_DS_REG); 
-	file->fops = (struct fileops *) (file + sizeof(struct file)); 
-	bzero((char *)file->fops, sizeof(struct fileops));
-	file->ref_count = 1;
-	file->offp = 0;
+	struct file_slot *slot = alloc_file_slot();
+	if(!slot)
+		return NULL;
+	bzero((char *)slot, sizeof(struct file_slot));
+	slot->file.fops = &slot->fops;
+	slot->file.ref_count = 1;
 	stats->file_objects++;
-	return file; 
+	return &slot->file;
 }
 
 void *alloc_memory_buffer()
@@ -49,16 +90,32 @@ void free_memory_buffer(void *ptr)
 
 static int do_read_kbd(struct file* filep, char * buff, u32 count)
 {
-	kbd_read(buff);
-	return 1;
+	int ret;
+
+	if(!count)
+		return 0;
+	ret = tty_read(buff, count);
+	return ret ? ret : -EAGAIN;   // read() waits for the line in file_wait
 }
 
-/* write call corresponding to stdout */
+/* write call corresponding to stdout, do_write takes MAX_WRITE_LEN at a time */
 
 static int do_write_console(struct file* filep, char * buff, u32 count)
 {
 	struct exec_context *current = get_current_ctx();
-	return do_write(current, (u64)buff, (u64)count);
+	u32 done = 0, len;
+	long ret;
+
+	while(done < count){
+		len = count - done > MAX_WRITE_LEN ? MAX_WRITE_LEN : count - done;
+		ret = do_write(current, (u64)(buff + done), (u64)len);
+		if(ret < 0)
+			return done ? done : ret;
+		done += ret;
+		if(ret < len)
+			break;
+	}
+	return done;
 }
 
 long std_close(struct file *filep)
@@ -68,6 +125,16 @@ long std_close(struct file *filep)
 		free_file_object(filep);
 	return 0;
 }
+static const struct fileops stdin_fops = {
+	.read = do_read_kbd,
+	.close = std_close,
+};
+
+static const struct fileops stdout_fops = {
+	.write = do_write_console,
+	.close = std_close,
+};
+
 struct file *create_standard_IO(int type)
 {
 	struct file *filep = alloc_file();
@@ -77,11 +144,10 @@ struct file *create_standard_IO(int type)
 	else
 		filep->mode = O_WRITE;
 	if(type == STDIN){
-		filep->fops->read = do_read_kbd;
+		filep->fops = &stdin_fops;
 	}else{
-		filep->fops->write = do_write_console;
+		filep->fops = &stdout_fops;
 	}
-	filep->fops->close = std_close;
 	return filep;
 }
 
@@ -91,13 +157,13 @@ int open_standard_IO(struct exec_context *ctx, int type)
 	struct file *filep = ctx->files[type];
 	if(!filep){
 		filep = create_standard_IO(type);
+		install_fd(ctx, fd, filep);
 	}else{
+		fd = alloc_fd(ctx, 3, filep);
+		if(fd < 0)
+			return -EOTHERS;
 		filep->ref_count++;
-		fd = 3;
-		while(ctx->files[fd])
-			fd++; 
 	}
-	ctx->files[fd] = filep;
 	return fd;
 }
 /**********************************************************************************/
@@ -105,18 +171,181 @@ int open_standard_IO(struct exec_context *ctx, int type)
 /**********************************************************************************/
 /**********************************************************************************/
 
+/*
+ * File descriptor table. Descriptors below MAX_OPEN_FILES are kept in
+ * exec_context::files, which the prebuilt pipe and scheduler code use
+ * directly; the ones from there up to MAX_FDS go in a per process array
+ * that doubles when a descriptor past its end is handed out. A bitmap of
+ * the descriptors in use gives the lowest free one a word at a time. The
+ * bits of files[] are refreshed before each search, since create_pipe
+ * fills those slots itself.
+ */
+struct fd_table{
+	u32 size;                       // descriptors with a slot
+	u64 open_map[FD_MAP_WORDS];     // bit set: descriptor in use
+	struct file **more;             // descriptors MAX_OPEN_FILES .. size - 1
+};
+
+static struct fd_table fd_tables[MAX_PROCESSES];   // by pid
+
+static inline struct fd_table *get_fd_table(struct exec_context *ctx)
+{
+	struct fd_table *table = &fd_tables[ctx -> pid];
+	if(!table -> size)
+		table -> size = MAX_OPEN_FILES;
+	return table;
+}
+
+static struct file **fd_array_alloc(u32 size)
+{
+	u32 bytes = (size - MAX_OPEN_FILES) * sizeof(struct file *);
+	struct file **array = bytes > PAGE_SIZE / 2 ? os_page_alloc(OS_DS_REG) : os_alloc(bytes);
+	if(array)
+		bzero((char *)array, bytes);
+	return array;
+}
+
+static void fd_array_free(struct file **array, u32 size)
+{
+	u32 bytes = (size - MAX_OPEN_FILES) * sizeof(struct file *);
+	if(!array)
+		return;
+	if(bytes > PAGE_SIZE / 2)
+		os_page_free(OS_DS_REG, array);
+	else
+		os_free(array, bytes);
+}
+
+/* Makes room for descriptor fd, returns -1 past MAX_FDS or without memory */
+static int grow_fd_table(struct fd_table *table, int fd)
+{
+	u32 size = table -> size < 64 ? 64 : table -> size;
+	struct file **more;
+	if(fd >= MAX_FDS)
+		return -1;
+	if(fd < table -> size)
+		return 0;
+	while(size <= fd)
+		size *= 2;
+	more = fd_array_alloc(size);
+	if(!more)
+		return -1;
+	if(table -> more)
+		memcpy((char *)more, (char *)table -> more, (table -> size - MAX_OPEN_FILES) * sizeof(struct file *));
+	fd_array_free(table -> more, table -> size);
+	table -> more = more;
+	table -> size = size;
+	return 0;
+}
+
+struct file *get_file(struct exec_context *ctx, int fd)
+{
+	struct fd_table *table;
+	if(fd < 0)
+		return NULL;
+	if(fd < MAX_OPEN_FILES)
+		return ctx -> files[fd];
+	table = get_fd_table(ctx);
+	return fd < table -> size ? table -> more[fd - MAX_OPEN_FILES] : NULL;
+}
+
+/* Points descriptor fd at filep (NULL to free it). Returns 0 or -1 */
+int install_fd(struct exec_context *ctx, int fd, struct file *filep)
+{
+	struct fd_table *table = get_fd_table(ctx);
+	if(fd < 0 || (filep && grow_fd_table(table, fd) < 0))
+		return -1;
+	if(fd >= table -> size)
+		return 0;   // never used, nothing to free
+	if(fd < MAX_OPEN_FILES)
+		ctx -> files[fd] = filep;
+	else
+		table -> more[fd - MAX_OPEN_FILES] = filep;
+	if(filep)
+		table -> open_map[fd / 64] |= 1ULL << (fd % 64);
+	else
+		table -> open_map[fd / 64] &= ~(1ULL << (fd % 64));
+	return 0;
+}
+
+/* Lowest free descriptor not below from, pointed at filep. Returns it or -1 */
+int alloc_fd(struct exec_context *ctx, int from, struct file *filep)
+{
+	struct fd_table *table = get_fd_table(ctx);
+	u64 free_bits, low = 0;
+	int i, fd;
+
+	for(i = 0; i < MAX_OPEN_FILES; i++)
+		if(ctx -> files[i])
+			low |= 1ULL << i;
+	table -> open_map[0] = (table -> open_map[0] & ~((1ULL << MAX_OPEN_FILES) - 1)) | low;
+	for(i = from / 64; i < FD_MAP_WORDS; i++){
+		free_bits = ~table -> open_map[i];
+		if(i == from / 64)
+			free_bits &= ~0ULL << (from % 64);
+		if(!free_bits)
+			continue;
+		fd = i * 64 + __builtin_ctzll(free_bits);
+		if(install_fd(ctx, fd, filep) < 0)
+			return -1;
+		return fd;
+	}
+	return -1;
+}
+
+/* Drops one reference of filep the way its close handler does */
+static void put_file(struct file *filep)
+{
+	if(filep -> fops && filep -> fops -> close){
+		filep -> fops -> close(filep);
+		return;
+	}
+	filep -> ref_count--;
+	if(!filep -> ref_count)
+		free_file_object(filep);
+}
+
+/* fork: the child gets the descriptors of the parent, each one more reference */
+void do_file_fork(struct exec_context *child, struct exec_context *parent)
+{
+	struct fd_table *ptable = get_fd_table(parent);
+	struct fd_table *ctable = &fd_tables[child -> pid];
+	struct file *filep;
+	int fd;
+
+	fd_array_free(ctable -> more, ctable -> size);
+	bzero((char *)ctable, sizeof(struct fd_table));
+	ctable -> size = MAX_OPEN_FILES;
+	for(fd = 0; fd < ptable -> size; fd++){
+		filep = get_file(parent, fd);
+		if(!filep)
+			continue;
+		if(fd >= MAX_OPEN_FILES && install_fd(child, fd, filep) < 0)
+			break;
+		filep -> ref_count++;
+	}
+	// files[] came with the copy of the context, set their bits
+	for(fd = 0; fd < MAX_OPEN_FILES; fd++)
+		if(child -> files[fd])
+			ctable -> open_map[0] |= 1ULL << fd;
+}
+
 /* File exit handler */
 void do_file_exit(struct exec_context *ctx)
 {
-	/*TODO the process is exiting. Adjust the refcount
-	of files*/
-	int max = MAX_OPEN_FILES;
-	for(int i = 0; i < max; i++){
-	    ctx -> files[i] -> ref_count --;
-	    if(!ctx -> files[i] -> ref_count)
-		free_file_object(ctx -> files[i]);
-	    ctx -> files[i] = NULL;
+	struct fd_table *table = get_fd_table(ctx);
+	struct file *filep;
+	int fd;
+
+	for(fd = 0; fd < table -> size; fd++){
+		filep = get_file(ctx, fd);
+		if(!filep)
+			continue;
+		install_fd(ctx, fd, NULL);
+		put_file(filep);
 	}
+	fd_array_free(table -> more, table -> size);
+	bzero((char *)table, sizeof(struct fd_table));
 }
 
 /*Regular file handlers to be written as part of the assignmemnt*/
@@ -131,17 +360,20 @@ static int do_read_regular(struct file *filep, char * buff, u32 count)
 	*  Incase of Error return valid Error code 
 	**/
 
-	if(filep == NULL)
+	int ret;
+	if(filep == NULL || (int)count < 0)
 		return -EINVAL;
 
-	if(filep != NULL){
-      	    if((filep -> inode -> mode & 0x1) && (filep -> mode & 0x1)){
-		filep -> offp += flat_read(filep -> inode, buff, count, &(filep -> offp));
-                return flat_read(filep -> inode, buff, count, &(filep -> offp));
-      	    }else{
-                return -EACCES;
-            }
-        }
+	if(!(filep -> inode -> mode & O_READ) || !(filep -> mode & O_READ))
+	    return -EACCES;
+	if(count > MAX_FILE_SIZE)
+		count = MAX_FILE_SIZE;
+	// one pass: flat_read copies straight into buff, then offp moves once
+	ret = flat_read(filep -> inode, buff, count, &(filep -> offp));
+	if(ret < 0)
+	    return -EINVAL;
+	filep -> offp += ret;
+	return ret;
 }
 
 /*write call corresponding to regular file */
@@ -154,20 +386,51 @@ static int do_write_regular(struct file *filep, char * buff, u32 count)
 	*   Validate the permission, file existence, Max length etc
 	*   Incase of Error return valid Error code 
 	* */
-	if(filep  != NULL){
-            if((filep -> inode -> mode & 0x2) && (filep -> mode & 0x2)){
-	        if(flat_write(filep -> inode, buff, count, &(filep -> offp)) < 0){
-                    return -EINVAL;
-                }else{
-                    filep -> offp += flat_write(filep -> inode, buff, count, &(filep -> offp));
-                    return flat_write(filep -> inode, buff, count, &(filep -> offp));
-                }
-            }else{
-                return -EACCES;
-            }
-        }
-        int ret_fd = -EINVAL; 
-        return ret_fd;
+	int ret;
+	if(filep == NULL || (int)count < 0)
+		return -EINVAL;
+
+	if(!(filep -> inode -> mode & O_WRITE) || !(filep -> mode & O_WRITE))
+	    return -EACCES;
+	ret = flat_write(filep -> inode, buff, count, &(filep -> offp));
+	if(ret < 0)
+	    return -EINVAL;
+	filep -> offp += ret;
+	return ret;
+}
+
+/*
+ * pread/pwrite on a regular file: I/O at an explicit offset, filep->offp
+ * is neither used nor moved. create_pipe does not set filep->type, so
+ * regular files are told apart by their read handler.
+ */
+static int is_regular_file(struct file *filep)
+{
+	return filep -> fops -> read == do_read_regular;
+}
+
+int do_pread_regular(struct file *filep, char *buff, u32 count, long offset)
+{
+	int ret, offp = offset;
+	if(filep == NULL || !is_regular_file(filep) || (int)count < 0 || offset < 0 || offset > MAX_FILE_SIZE)
+		return -EINVAL;
+	if(!(filep -> inode -> mode & O_READ) || !(filep -> mode & O_READ))
+	    return -EACCES;
+	if(count > MAX_FILE_SIZE)
+		count = MAX_FILE_SIZE;
+	ret = flat_read(filep -> inode, buff, count, &offp);
+	return ret < 0 ? -EINVAL : ret;
+}
+
+int do_pwrite_regular(struct file *filep, char *buff, u32 count, long offset)
+{
+	int ret, offp = offset;
+	if(filep == NULL || !is_regular_file(filep) || (int)count < 0 || offset < 0 || offset > MAX_FILE_SIZE)
+		return -EINVAL;
+	if(!(filep -> inode -> mode & O_WRITE) || !(filep -> mode & O_WRITE))
+	    return -EACCES;
+	ret = flat_write(filep -> inode, buff, count, &offp);
+	return ret < 0 ? -EINVAL : ret;
 }
 
 long do_file_close(struct file *filep)
@@ -197,28 +460,35 @@ static long do_lseek_regular(struct file *filep, long offset, int whence)
 	if(!filep)
             return -EINVAL;
 
+        // Seeking past the end is allowed, a later write leaves a hole
         long updated_off;
     	if(whence == SEEK_CUR){
-	    if(filep -> inode -> file_size < filep -> offp + offset)
-		return -EINVAL;
             updated_off = filep -> offp + offset;
     	}else if(whence == SEEK_SET){
-	    if(filep -> inode -> file_size < offset)
-		return -EINVAL;
             updated_off = offset;
     	}else if(whence == SEEK_END){
-	    if(filep -> inode -> file_size < filep -> inode -> file_size + offset)
-		return -EINVAL;
             updated_off = filep -> inode -> file_size + offset;
+    	}else if(whence == SEEK_DATA || whence == SEEK_HOLE){
+            updated_off = flat_seek_hole(filep -> inode, offset, whence == SEEK_DATA);
     	}else{
             int ret_fd = -EINVAL; 
             return ret_fd;
     	}
+        if(updated_off < 0 || updated_off > MAX_FILE_SIZE)
+            return -EINVAL;
     
+        filep -> inode -> seeks++;   // rejected seeks are not counted
         filep -> offp = updated_off;
         return updated_off;
 }
 
+static const struct fileops regular_fops = {
+	.read = do_read_regular,
+	.write = do_write_regular,
+	.lseek = do_lseek_regular,
+	.close = do_file_close,
+};
+
 extern int do_regular_file_open(struct exec_context *ctx, char* filename, u64 flags, u64 mode)
 {
 
@@ -227,54 +497,60 @@ extern int do_regular_file_open(struct exec_context *ctx, char* filename, u64 fl
 	*  You should be creating file(use the alloc_file function to creat file), 
 	*  To create or Get inode use File system function calls, 
 	*  Handle mode and flags 
-	*  Validate file existence, Max File count is 16, Max Size is 4KB, etc
+	*  Validate file existence, Max File count is 16, Max Size is MAX_FILE_SIZE, etc
 	*  Incase of Error return valid Error code 
 	* */
 	struct inode* reg_inode = lookup_inode(filename);	
-	struct file *flp = alloc_file();
-    	
-	if(flp == NULL){
-      	    return -ENOMEM;
-    	}
+	struct super_block *sb;
+	struct file *flp;
+	int created = 0, ret;
         
         if(((flags & O_WRITE) && (!(mode & O_WRITE))) || ((!(mode & O_READ)) && (flags & O_READ))){
       	    return -EACCES;
       	}
 	
-	if(reg_inode -> file_size > FILE_SIZE)
+	if(reg_inode && reg_inode -> file_size > MAX_FILE_SIZE)
             return -EOTHERS;
 
       	if(!reg_inode){
 	    if(flags & O_CREAT){
-                struct inode* new_inode = create_inode(filename, mode);
-		if(!new_inode)	
+                reg_inode = create_inode(filename, mode);
+		if(!reg_inode)	
 			return -EOTHERS;
-       	        flp -> inode = new_inode;
+		created = 1;
 	    }
 	    else
 		return -EINVAL;
 	}
+	flp = alloc_file();
+	if(flp == NULL){
+	    ret = -ENOMEM;
+	    goto drop_inode;
+    	}
         flp -> inode = reg_inode;
 
-
         flp -> mode = flags;
-        flp -> fops -> write = do_write_regular;
-        flp -> fops -> close = do_file_close;
-        flp -> fops -> read = do_read_regular;
+        flp -> fops = &regular_fops;
         flp -> pipe = NULL;
-        flp -> fops -> lseek = do_lseek_regular;
         flp -> offp = 0;
         flp -> type = REGULAR;
         
-	int i = 3;
-        while(ctx -> files[i]){
-            if(i == 31){
-                return -EOTHERS;
-            }
-            i++;
+	ret = alloc_fd(ctx, 3, flp);
+	if(ret < 0){
+            free_file_object(flp);
+            ret = -EOTHERS;
+            goto drop_inode;
         }
-        ctx->files[i] = flp;
-        return i;
+        reg_inode -> opens++;
+        return ret;
+
+drop_inode:
+	if(created){
+		// nobody has seen the new file yet, drop it again
+		sb = get_superblock();
+		sb -> sb_op -> remove_inode(sb, reg_inode);
+	}
+	return ret;
 }
 
 /**
@@ -286,68 +562,625 @@ int fd_dup2(struct exec_context *current, int oldfd, int newfd)
 	*  TODO Implementation of the dup2 
 	*  Incase of Error return valid Error code 
 	**/
-	if(newfd < 0 || newfd > MAX_OPEN_FILES || oldfd < 0 || oldfd > MAX_OPEN_FILES)
-		return -EINVAL; 
+	struct file *filep = get_file(current, oldfd);
+	struct file *old_newfd;
 
-	if(current -> files[oldfd] == NULL){
-            return -EINVAL;
-        }
-	
-	if(!current -> files[newfd]){
-      	    free_file_object(current -> files[newfd]);
-            current -> files[newfd] = NULL;
-        }
+	if(!filep || newfd < 0 || newfd >= MAX_FDS)
+		return -EINVAL; 
 
-    	if(newfd == oldfd){
-      	    current -> files[newfd] -> ref_count ++;
+    	if(newfd == oldfd)
       	    return newfd;
-    	}
 	
-       	current -> files[newfd] = current -> files[oldfd];
-    	current -> files[newfd] -> ref_count ++;
+	old_newfd = get_file(current, newfd);
+	if(install_fd(current, newfd, filep) < 0)
+	    return -ENOMEM;
+	filep -> ref_count ++;
+	if(old_newfd)
+	    put_file(old_newfd);
     	return newfd;
 }
 
+/*
+ * Pipes. create_pipe fills in private fops that call pipe_read and
+ * pipe_write, which move the data a byte at a time; open_pipe swaps in
+ * the tables below, which copy it with memcpy, at most two spans per
+ * call since the buffer is a ring. The ring layout is pipe.o's: read_pos
+ * is the next byte to read, write_pos the last byte written, both -1
+ * while the pipe is empty.
+ *
+ * They also wake the contexts sleeping on pipe_wait whenever data or
+ * room shows up or an end goes away. One queue serves all pipes, a
+ * waiter woken for another pipe goes back to sleep when its read or
+ * write runs again.
+ */
+static struct wait_queue pipe_wait;
+
+static u32 pipe_bytes(struct file *filep)
+{
+	return filep -> pipe -> buffer_offset;
+}
+
+static u32 pipe_room(struct file *filep)
+{
+	return PIPE_MAX_SIZE - filep -> pipe -> buffer_offset;
+}
+
+/* Drops count bytes from the front of the pipe */
+static void pipe_drop(struct pipe_info *pipe, u32 count)
+{
+	pipe -> buffer_offset -= count;
+	if(!pipe -> buffer_offset)
+		pipe -> read_pos = pipe -> write_pos = -1;
+	else
+		pipe -> read_pos = (pipe -> read_pos + count) % PIPE_MAX_SIZE;
+}
+
+static int pipe_read_wake(struct file *filep, char *buff, u32 count)
+{
+	struct pipe_info *pipe = filep -> pipe;
+	u32 first;
+
+	if(!pipe -> buffer_offset)
+		return pipe -> is_wopen ? -EAGAIN : 0;   // no writer left, end of file
+	if(count > pipe -> buffer_offset)
+		count = pipe -> buffer_offset;   // short read
+	if(!count)
+		return 0;
+	first = PIPE_MAX_SIZE - pipe -> read_pos;
+	if(first > count)
+		first = count;
+	memcpy(buff, pipe -> pipe_buff + pipe -> read_pos, first);
+	memcpy(buff + first, pipe -> pipe_buff, count - first);
+	pipe_drop(pipe, count);
+	wake_up(&pipe_wait);
+	return count;
+}
+
+/* All or nothing, like pipe_write */
+static int pipe_write_wake(struct file *filep, char *buff, u32 count)
+{
+	struct pipe_info *pipe = filep -> pipe;
+	u32 pos, first;
+
+	if(count > pipe_room(filep))
+		return -EINVAL;
+	if(!count)
+		return 0;
+	if(!pipe -> buffer_offset){
+		pos = 0;
+		pipe -> read_pos = 0;
+	}else{
+		pos = (pipe -> write_pos + 1) % PIPE_MAX_SIZE;
+	}
+	first = PIPE_MAX_SIZE - pos;
+	if(first > count)
+		first = count;
+	memcpy(pipe -> pipe_buff + pos, buff, first);
+	memcpy(pipe -> pipe_buff, buff + first, count - first);
+	pipe -> write_pos = (pos + count - 1) % PIPE_MAX_SIZE;
+	pipe -> buffer_offset += count;
+	wake_up(&pipe_wait);
+	return count;
+}
+
+static long pipe_close_wake(struct file *filep)
+{
+	long ret = pipe_close(filep);
+	wake_up(&pipe_wait);
+	return ret;
+}
+
+static const struct fileops pipe_read_fops = {
+	.read = pipe_read_wake,
+	.close = pipe_close_wake,
+};
+
+static const struct fileops pipe_write_fops = {
+	.write = pipe_write_wake,
+	.close = pipe_close_wake,
+};
+
+int open_pipe(struct exec_context *ctx, int *fd)
+{
+	int ret = create_pipe(ctx, fd);
+	if(ret < 0)
+		return ret;
+	get_file(ctx, fd[0]) -> fops = &pipe_read_fops;
+	get_file(ctx, fd[1]) -> fops = &pipe_write_fops;
+	return ret;
+}
+
+static int is_pipe(struct file *filep)
+{
+	return filep -> fops == &pipe_read_fops || filep -> fops == &pipe_write_fops;
+}
+
+/*
+ * read() and write() park here while a pipe has nothing to read or no
+ * room for the whole write, or stdin has no finished line, and run again
+ * once woken. The vector calls, sendfile, splice and io_enter never wait.
+ */
+void file_wait(struct exec_context *ctx, int fd, u32 count, int write)
+{
+	struct file *filep = get_file(ctx, fd);
+	struct pipe_info *pipe;
+
+	wait_clear(ctx);   // woken or not waiting at all, wait_event sets it again
+	if(!filep || !count)
+		return;
+	if(filep -> fops == &stdin_fops && !write){
+		if(!tty_ready())
+			wait_event(&tty_wait, 0);   // until tty_tick finishes a line
+		return;
+	}
+	pipe = filep -> pipe;
+	if(filep -> fops == &pipe_read_fops && !write){
+		if(!pipe -> buffer_offset && pipe -> is_wopen)
+			wait_event(&pipe_wait, 0);
+	}else if(filep -> fops == &pipe_write_fops && write){
+		if(count <= PIPE_MAX_SIZE && pipe_room(filep) < count && pipe -> is_ropen)
+			wait_event(&pipe_wait, 0);
+	}
+}
+
+/*
+ * sendfile moves count bytes page by page, with no bounce buffer: data
+ * goes from the store pages of a regular file straight to the write
+ * handler of outfd (regular file or pipe), or from a pipe
+ * straight into the store pages of a regular file. With offset set the
+ * regular file infd is read from *offset, which is advanced, and its
+ * own offset is left alone.
+ */
+static char zero_page[PAGE_SIZE];   // source of the holes of sparse files
+
+/*
+ * Pipe writes fail a request they cannot do in full, so chunks to and
+ * from a pipe are cut to what it holds or has room for.
+ */
+static int sendfile_from_file(struct file *file_in, struct file *file_out, u32 *pos, int count)
+{
+	struct inode *inode = file_in -> inode;
+	char *data;
+	u32 len;
+	int ret, done = 0;
+
+	while(done < count && flat_file_data(inode, *pos, 0, &data, &len) == 0){
+		if(len > count - done)
+			len = count - done;
+		if(is_pipe(file_out) && len > pipe_room(file_out))
+			len = pipe_room(file_out);
+		if(!len)
+			break;   // pipe full
+		ret = file_out -> fops -> write(file_out, data ? data : zero_page, len);
+		if(ret <= 0)
+			break;
+		flat_io_done(inode, *pos, ret, 0);
+		*pos += ret;
+		done += ret;
+		if(ret < len)
+			break;
+	}
+	return done;
+}
+
+static int sendfile_from_pipe(struct file *file_in, struct file *file_out, int count)
+{
+	struct inode *inode = file_out -> inode;
+	char *data;
+	u32 len;
+	int ret, done = 0;
+
+	// stop once the pipe is empty, before a page is allocated for nothing
+	while(done < count && pipe_bytes(file_in) && flat_file_data(inode, file_out -> offp, 1, &data, &len) == 0){
+		if(len > count - done)
+			len = count - done;
+		if(len > pipe_bytes(file_in))
+			len = pipe_bytes(file_in);
+		ret = file_in -> fops -> read(file_in, data, len);
+		if(ret <= 0)
+			break;
+		flat_io_done(inode, file_out -> offp, ret, 1);
+		file_out -> offp += ret;
+		done += ret;
+	}
+	return done;
+}
+
 int do_sendfile(struct exec_context *ctx, int outfd, int infd, long *offset, int count) {
-	/** 
-	*  TODO Implementation of the sendfile 
-	*  Incase of Error return valid Error code 
-	**/
-	if(infd < 0 || infd > MAX_OPEN_FILES || outfd < 0 || outfd > MAX_OPEN_FILES)
+	struct file *file_in, *file_out;
+	u32 pos;
+	int done;
+
+	if(count < 0)
 		return -EINVAL;
-	if(!ctx -> files[outfd] || !ctx -> files[infd])
+	file_in = get_file(ctx, infd);
+	file_out = get_file(ctx, outfd);
+	if(!file_in || !file_out)
 		return -EINVAL;
-	if( !((ctx -> files[infd]) -> inode -> mode & O_READ) || !((ctx -> files[outfd]) -> inode -> mode & O_WRITE))
+	if(!(file_in -> mode & O_READ) || !(file_out -> mode & O_WRITE))
 		return -EACCES;
-	
-	void *mem_buffer = alloc_memory_buffer();
-	if(!mem_buffer)
+
+	if(is_regular_file(file_in)){
+		if(!(file_in -> inode -> mode & O_READ))
+			return -EACCES;
+		// the console write handler only takes user buffers
+		if(!is_regular_file(file_out) && !is_pipe(file_out))
+			return -EINVAL;
+		if(is_regular_file(file_out) && file_out -> inode == file_in -> inode)
+			return -EINVAL;
+		if(offset && (*offset < 0 || *offset > MAX_FILE_SIZE))
+			return -EINVAL;
+		pos = offset ? *offset : file_in -> offp;
+		done = sendfile_from_file(file_in, file_out, &pos, count);
+		if(offset)
+			*offset = pos;
+		else
+			file_in -> offp = pos;
+		return done;
+	}
+	// a pipe can only be sent to a regular file
+	if(offset || !is_regular_file(file_out) || !is_pipe(file_in))
+		return -EINVAL;
+	if(!(file_out -> inode -> mode & O_WRITE))
+		return -EACCES;
+	return sendfile_from_pipe(file_in, file_out, count);
+}
+
+/*
+ * Pipe to pipe for splice and tee: the bytes of pipe_in are handed to
+ * pipe_write of file_out straight from the pipe buffer, a contiguous run
+ * at a time. With consume set they are then dropped from pipe_in,
+ * otherwise pipe_in is left as it was.
+ */
+static int pipe_to_pipe(struct file *file_in, struct file *file_out, int count, int consume)
+{
+	struct pipe_info *pipe = file_in -> pipe;
+	u32 len, pos, skip = 0;
+	int ret, done = 0;
+
+	while(done < count && skip < pipe -> buffer_offset && pipe_room(file_out)){
+		pos = (pipe -> read_pos + skip) % PIPE_MAX_SIZE;
+		len = PIPE_MAX_SIZE - pos;
+		if(len > pipe -> buffer_offset - skip)
+			len = pipe -> buffer_offset - skip;
+		if(len > count - done)
+			len = count - done;
+		if(len > pipe_room(file_out))
+			len = pipe_room(file_out);
+		ret = file_out -> fops -> write(file_out, pipe -> pipe_buff + pos, len);
+		if(ret <= 0)
+			break;
+		done += ret;
+		if(!consume){
+			skip += ret;
+			continue;
+		}
+		pipe_drop(pipe, ret);
+	}
+	return done;
+}
+
+/*
+ * splice: moves up to len bytes from fd_in to fd_out inside the kernel,
+ * one end being a pipe. Regular files are read and written at their
+ * file offset. Returns the bytes moved.
+ */
+int do_splice(struct exec_context *ctx, int fd_in, int fd_out, int len)
+{
+	struct file *file_in, *file_out;
+	u32 pos;
+	int done;
+
+	if(len < 0)
+		return -EINVAL;
+	file_in = get_file(ctx, fd_in);
+	file_out = get_file(ctx, fd_out);
+	if(!file_in || !file_out || (!is_pipe(file_in) && !is_pipe(file_out)))
+		return -EINVAL;
+	if(!(file_in -> mode & O_READ) || !(file_out -> mode & O_WRITE))
+		return -EACCES;
+
+	if(is_pipe(file_in) && is_pipe(file_out)){
+		if(file_in -> pipe == file_out -> pipe)
+			return -EINVAL;
+		return pipe_to_pipe(file_in, file_out, len, 1);
+	}
+	if(is_pipe(file_in)){
+		if(!is_regular_file(file_out))
+			return -EINVAL;
+		if(!(file_out -> inode -> mode & O_WRITE))
+			return -EACCES;
+		return sendfile_from_pipe(file_in, file_out, len);
+	}
+	if(!is_regular_file(file_in))
+		return -EINVAL;
+	if(!(file_in -> inode -> mode & O_READ))
+		return -EACCES;
+	pos = file_in -> offp;
+	done = sendfile_from_file(file_in, file_out, &pos, len);
+	file_in -> offp = pos;
+	return done;
+}
+
+/* tee: copies up to len bytes from pipe fd_in to pipe fd_out, fd_in keeps them */
+int do_tee(struct exec_context *ctx, int fd_in, int fd_out, int len)
+{
+	struct file *file_in, *file_out;
+
+	if(len < 0)
+		return -EINVAL;
+	file_in = get_file(ctx, fd_in);
+	file_out = get_file(ctx, fd_out);
+	if(!file_in || !file_out || !is_pipe(file_in) || !is_pipe(file_out) || file_in -> pipe == file_out -> pipe)
+		return -EINVAL;
+	if(!(file_in -> mode & O_READ) || !(file_out -> mode & O_WRITE))
+		return -EACCES;
+	return pipe_to_pipe(file_in, file_out, len, 0);
+}
+
+/*
+ * getdents: fills buf with dir_entry records starting from *cookie, see
+ * flat_list_all_files. Returns bytes filled, 0 at the end of the listing.
+ */
+int do_getdents(struct exec_context *ctx, void *buf, int count, u32 *cookie)
+{
+	struct super_block *sb = get_superblock();
+	int ret;
+	if(!buf || !cookie || count <= 0)
+		return -EINVAL;
+	ret = sb->sb_op->list_all_files(sb, buf, count, cookie);
+	if(ret < 0)
+		return -EINVAL;
+	return ret;
+}
+
+/*
+ * fclone: creates dst sharing the data pages of src (copy-on-write), so
+ * the copy costs only the block map. Needs read permission on src.
+ */
+int do_fclone(struct exec_context *ctx, char *src, char *dst)
+{
+	struct super_block *sb = get_superblock();
+	struct inode *src_inode;
+	if(!src || !dst)
+		return -EINVAL;
+	src_inode = lookup_inode(src);
+	if(!src_inode)
+		return -EINVAL;
+	if(!(src_inode -> mode & O_READ))
+		return -EACCES;
+	if(lookup_inode(dst))
+		return -EINVAL;
+	if(sb->sb_op->clone_inode(sb, src_inode, dst) < 0)
 		return -ENOMEM;
-	
-	struct file *file_in = ctx -> files[infd];
-	struct file *file_out = ctx -> files[outfd];
-
-	if(offset){
-	    u32 offp = file_in -> offp;
-	    file_in -> offp = *offset;
-	    int in_size = file_in -> fops -> read(file_in, mem_buffer, count);
-	    int out_size = file_out -> fops -> write(file_out, mem_buffer, in_size);
-	    if(in_size < 0 || out_size < 0)
-	        return -EINVAL;
-	    file_in -> offp = offp;
-	    free_memory_buffer(mem_buffer);
-	    return  out_size;
-	
-       }
-	
-	if(!offset){
-	    int in_size = file_in -> fops -> read(file_in, mem_buffer, count);
-	    int out_size = file_out -> fops -> write(file_out, mem_buffer, in_size);
-	    if(file_in -> fops -> read(file_in, mem_buffer, count) < 0 || file_out -> fops -> write(file_out, mem_buffer, in_size) < 0)
-	        return -EINVAL;
-	    free_memory_buffer(mem_buffer);
-	    return  out_size;
+	return 0;
+}
+
+/*
+ * fdedup: DEDUP_RUN runs a dedup pass, DEDUP_ON/DEDUP_OFF switch write
+ * time dedup. Returns the bytes currently saved by shared store pages.
+ */
+long do_fdedup(struct exec_context *ctx, int cmd)
+{
+	struct super_block *sb = get_superblock();
+	int ret;
+	if(cmd == DEDUP_RUN)
+		ret = flat_dedup(sb);
+	else if(cmd == DEDUP_ON || cmd == DEDUP_OFF)
+		ret = flat_dedup_mode(sb, cmd == DEDUP_ON);
+	else
+		return -EINVAL;
+	if(ret < 0)
+		return -ENOMEM;
+	return sb->fs_stats.shared_bytes;
+}
+
+/*
+ * fcompress: compresses file pages not accessed for cold_ticks ticks (no
+ * pass if cold_ticks < 0) and copies the compression stats to st if it
+ * is not NULL. Returns the number of pages compressed.
+ */
+int do_fcompress(struct exec_context *ctx, int cold_ticks, struct fcompress_stats *st)
+{
+	struct super_block *sb = get_superblock();
+	int ret = 0;
+	if(cold_ticks >= 0){
+		ret = flat_compress(sb, cold_ticks);
+		if(ret < 0)
+			return -ENOMEM;
+	}
+	if(st){
+		st->compressed_pages = sb->z_pages;
+		st->compressed_bytes = sb->z_bytes;
+		st->pool_pages = sb->zpool_pages;
+		st->decompressions = sb->z_decompressions;
+		st->decompress_cycles = sb->z_decompress_cycles;
+	}
+	return ret;
+}
+
+/*
+ * fsstats: copies the file system counters to st (if not NULL) and the
+ * per file counters of up to count files, from *cookie on, to buf.
+ * Returns the number of inode_stats records filled.
+ */
+int do_fsstats(struct exec_context *ctx, struct fs_stats *st, struct inode_stats *buf, int count, u32 *cookie)
+{
+	struct super_block *sb = get_superblock();
+	if(st){
+		memcpy((char *)st, (char *)&sb->fs_stats, sizeof(struct fs_stats));
+		st->num_files = sb->num_files;
+	}
+	if(!buf || count <= 0)
+		return 0;
+	if(!cookie)
+		return -EINVAL;
+	return flat_inode_stats(sb, buf, count, cookie);
+}
+
+/*
+ * File backed mmap. Every page of the range is mapped up front to the
+ * store page of the file (pinned by flat_map_page), so loads and stores
+ * through the mapping go straight to the file with no copy and no page
+ * faults. vm_area_unmap hands the pfns of a range back to USER_REG, so
+ * the file pages are unmapped by do_file_munmap before it runs; the
+ * ranges each process has mapped from files are kept in file_maps.
+ */
+struct file_map{
+	u32 pid;
+	u64 start;
+	u64 end;
+	struct file_map *next;
+};
+
+static struct file_map *file_maps;
+
+static inline void invlpg(u64 addr)
+{
+	asm volatile("invlpg (%0);" :: "r" (addr) : "memory");
+}
+
+static int add_file_map(u32 pid, u64 start, u64 end)
+{
+	struct file_map *map = os_alloc(sizeof(struct file_map));
+	if(!map)
+		return -1;
+	map->pid = pid;
+	map->start = start;
+	map->end = end;
+	map->next = file_maps;
+	file_maps = map;
+	return 0;
+}
+
+/* Clears the PTEs of file pages in [start, end) and unpins the pages */
+static void unmap_file_pages(struct exec_context *ctx, u64 start, u64 end)
+{
+	u64 addr, *pte;
+	for(addr = start; addr < end; addr += PAGE_SIZE){
+		pte = get_user_pte(ctx, addr, 0);
+		if(!pte || !(*pte & 1))
+			continue;
+		flat_unpin_page((*pte >> PAGE_SHIFT) & 0xffffffff);
+		*pte = 0;
+		invlpg(addr);
 	}
-	return -EINVAL;
 }
 
+/* Drops the file mappings of ctx in [start, end), splitting ranges as needed */
+static void file_unmap_range(struct exec_context *ctx, u64 start, u64 end)
+{
+	struct file_map **prev = &file_maps, *map;
+	u64 lo, hi;
+
+	while((map = *prev)){
+		if(map->pid != ctx->pid || map->end <= start || map->start >= end){
+			prev = &map->next;
+			continue;
+		}
+		lo = map->start > start ? map->start : start;
+		hi = map->end < end ? map->end : end;
+		unmap_file_pages(ctx, lo, hi);
+		if(map->start < lo && map->end > hi && add_file_map(ctx->pid, hi, map->end) < 0)
+			unmap_file_pages(ctx, hi, map->end);   // keep the tail unmapped rather than untracked
+		if(map->start < lo){
+			map->end = lo;
+			prev = &map->next;
+			continue;
+		}
+		if(map->end > hi){
+			map->start = hi;
+			prev = &map->next;
+			continue;
+		}
+		*prev = map->next;
+		os_free(map, sizeof(struct file_map));
+	}
+}
+
+/* munmap: called before vm_area_unmap, see above */
+void do_file_munmap(struct exec_context *ctx, u64 addr, int length)
+{
+	if(length > 0)
+		file_unmap_range(ctx, addr, addr + (((u64)length + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1)));
+}
+
+/* Process exit: the pages of its file mappings go back to the files */
+void do_file_mmap_exit(struct exec_context *ctx)
+{
+	file_unmap_range(ctx, 0, ~0UL);
+}
+
+/*
+ * fork: copy_mm only copies the segments, so the child gets the file
+ * mappings of the parent mapped to the same store pages.
+ */
+void do_file_mmap_fork(struct exec_context *child, struct exec_context *parent)
+{
+	struct file_map *map;
+	u64 addr, *pte;
+	u32 pfn;
+
+	for(map = file_maps; map; map = map->next){
+		if(map->pid != parent->pid)
+			continue;
+		if(add_file_map(child->pid, map->start, map->end) < 0)
+			return;
+		for(addr = map->start; addr < map->end; addr += PAGE_SIZE){
+			pte = get_user_pte(parent, addr, 0);
+			if(!pte || !(*pte & 1))
+				continue;
+			pfn = (*pte >> PAGE_SHIFT) & 0xffffffff;
+			if(flat_pin_page(pfn) < 0)
+				continue;
+			map_physical_page((u64)osmap(child->pgd), addr, (*pte & 2) ? MM_WR : 0, pfn);
+		}
+	}
+}
+
+/*
+ * Maps length bytes of the regular file fd from offset (page aligned) with
+ * prot PROT_READ or PROT_READ|PROT_WRITE; the range has to be inside the
+ * last page of the file. Writes through the mapping change the file (it
+ * is a shared mapping) but do not extend it. Returns the address.
+ */
+long do_mmap_file(struct exec_context *ctx, int fd, long offset, int length, int prot)
+{
+	struct file *filep;
+	struct inode *inode;
+	long addr, pfn;
+	int i, pages;
+
+	if(!(filep = get_file(ctx, fd)) || !is_regular_file(filep))
+		return -EINVAL;
+	inode = filep -> inode;
+	if(offset < 0 || (offset & (PAGE_SIZE - 1)) || length <= 0 || offset + length > MAX_FILE_SIZE)
+		return -EINVAL;
+	if(prot != PROT_READ && prot != (PROT_READ | PROT_WRITE))
+		return -EINVAL;
+	if(offset + length > ((inode -> file_size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1)))
+		return -EINVAL;
+	if(!(inode -> mode & O_READ) || !(filep -> mode & O_READ))
+		return -EACCES;
+	if((prot & PROT_WRITE) && (!(inode -> mode & O_WRITE) || !(filep -> mode & O_WRITE)))
+		return -EACCES;
+
+	pages = (length + PAGE_SIZE - 1) >> PAGE_SHIFT;
+	addr = vm_area_map(ctx, 0, length, prot, 0);
+	if(addr < 0)
+		return -ENOMEM;
+	if(add_file_map(ctx -> pid, addr, addr + ((u64)pages << PAGE_SHIFT)) < 0){
+		vm_area_unmap(ctx, addr, length);
+		return -ENOMEM;
+	}
+	for(i = 0; i < pages; i++){
+		pfn = flat_map_page(inode, (offset >> PAGE_SHIFT) + i);
+		if(pfn < 0){
+			file_unmap_range(ctx, addr, addr + ((u64)pages << PAGE_SHIFT));
+			vm_area_unmap(ctx, addr, length);
+			return -ENOMEM;
+		}
+		map_physical_page((u64)osmap(ctx -> pgd), addr + ((u64)i << PAGE_SHIFT), prot, pfn);
+	}
+	return addr;
+}
@@ -4,71 +4,613 @@
 #include<file.h>
 #include<memory.h>
 #include<context.h>
+#include<entry.h>
 
 struct super_block* super_block; 
 
-u64 get_contigous_pages(u32 region, int number_of_pages)
+static u32 pages_to_order(int number_of_pages)
 {
-	int i;
-	u32 startpfn, prevpfn, currentpfn;
-	u64 first_page = os_pfn_alloc(region);
-	prevpfn = first_page;
+	u32 order = 0;
+	while( (1 << order) < number_of_pages )
+		order++;
+	return order;
+}
 
-	for(i =1; i < number_of_pages; i++)
+/* Gives pages [pfn, pfn + count) back as the largest aligned blocks */
+static void free_page_range(u32 region, u32 pfn, u32 count)
+{
+	u32 order;
+	while( count )
 	{
-		currentpfn = os_pfn_alloc(region);
-		if(currentpfn != prevpfn + 1)
-			dprintk("Error in get contiguous region %s\n", __func__);
-		prevpfn = currentpfn;
+		order = 0;
+		while( order < BUDDY_MAX_ORDER && !(pfn & (1 << order)) && (2 << order) <= count )
+			order++;
+		buddy_free(region, pfn, order);
+		pfn += 1 << order;
+		count -= 1 << order;
 	}
+}
+
+/*
+ * Returns a zeroed run of number_of_pages physically contiguous pages, or 0.
+ * The run comes from the buddy allocator of the region, the pages past
+ * number_of_pages in the power of two block are given back right away.
+ * Free the run with put_contigous_pages.
+ */
+u64 get_contigous_pages(u32 region, int number_of_pages)
+{
+	u32 order = pages_to_order(number_of_pages);
+	u64 first_page = buddy_alloc(region, order);
+	if( !first_page )
+		return 0;
+	free_page_range(region, first_page + number_of_pages, (1 << order) - number_of_pages);
 	first_page = first_page  << PAGE_SHIFT;
 	bzero((char*)first_page, (PAGE_SIZE * number_of_pages));
 	return first_page;
 }
 
-void init_file_inode(struct super_block * super_block)
+void put_contigous_pages(u32 region, u64 address, int number_of_pages)
+{
+	free_page_range(region, address >> PAGE_SHIFT, number_of_pages);
+}
+
+/*
+ * Block map helpers. Returns the slot holding the pfn of file page
+ * "index", allocating the indirect page on demand when alloc is set.
+ */
+static u32* get_block_slot(struct inode *inode, u32 index, int alloc)
+{
+	u32 *indirect;
+	if( index < INODE_DIRECT_BLOCKS )
+		return &inode->blocks[index];
+	index -= INODE_DIRECT_BLOCKS;
+	if( index >= BLOCKS_PER_INDIRECT )
+		return NULL;
+	if( !inode->indirect )
+	{
+		u64 page;
+		if( !alloc )
+			return NULL;
+		page = get_contigous_pages(FILE_DS_REG, 1);
+		if( !page )
+			return NULL;
+		inode->indirect = page >> PAGE_SHIFT;
+	}
+	indirect = (u32 *)((u64)inode->indirect << PAGE_SHIFT);
+	return &indirect[index];
+}
+
+/*
+ * Tables with an entry per FILE_STORE_REG page are only allocated the
+ * first time they are needed, zeroed, the way the dedup index is. A boot
+ * that never shares, maps or compresses a page pays nothing for them.
+ */
+static void* store_table(void **table, u32 entry_size)
+{
+	if( !*table )
+		*table = (void *)get_contigous_pages(FILE_DS_REG, (entry_size * STORE_PAGES + PAGE_SIZE - 1) / PAGE_SIZE);
+	return *table;
+}
+
+/*
+ * FILE_STORE_REG pages can be shared by several block maps (see
+ * flat_clone_inode). A store page starts with one user, and
+ * super_block->page_refs counts the slots pointing at it past the first,
+ * so a table that shows up late reads right for every page. A page goes
+ * back to the allocator when its last user drops it.
+ */
+static inline u16 page_shares(u32 pfn)
+{
+	return super_block->page_refs ? super_block->page_refs[pfn - STORE_START_PFN] : 0;
+}
+
+static inline u16 page_pinned(u32 pfn)
+{
+	return super_block->page_pins ? super_block->page_pins[pfn - STORE_START_PFN] : 0;
+}
+
+static u32 alloc_store_page(void)
+{
+	u64 page = get_contigous_pages(FILE_STORE_REG, 1);
+	if( !page )
+		return 0;
+	return page >> PAGE_SHIFT;
+}
+
+static void dedup_unlink(u32 pfn);
+
+static void put_store_page(u32 pfn)
+{
+	if( page_shares(pfn) )
+	{
+		super_block->page_refs[pfn - STORE_START_PFN]--;
+		super_block->fs_stats.shared_bytes -= PAGE_SIZE;
+		return;
+	}
+	// a page still mapped by a process is freed by flat_unpin_page
+	if( page_pinned(pfn) )
+	{
+		super_block->page_pins[pfn - STORE_START_PFN] |= PIN_ORPHAN;
+		return;
+	}
+	dedup_unlink(pfn);
+	buddy_free(FILE_STORE_REG, pfn, 0);
+}
+
+/*
+ * Takes one more reference on pfn, or a private copy if the count is full
+ * or the page is mapped: a mapped page is written in place, so it must
+ * only belong to one file.
+ */
+static u32 share_store_page(u32 pfn)
 {
-	int index;
-	u32 total_inode_page = ((sizeof(struct inode) * NUM_FILES)/PAGE_SIZE) + 3;
-	u64 inode_pfn = get_contigous_pages(FILE_DS_REG, total_inode_page);
+	u32 copy;
+	if( page_shares(pfn) < STORE_REF_MAX - 1 && !page_pinned(pfn) && store_table((void **)&super_block->page_refs, sizeof(u16)) )
+	{
+		super_block->page_refs[pfn - STORE_START_PFN]++;
+		super_block->fs_stats.shared_bytes += PAGE_SIZE;
+		return pfn;
+	}
+	copy = alloc_store_page();
+	if( copy )
+		memcpy((char *)((u64)copy << PAGE_SHIFT), (char *)((u64)pfn << PAGE_SHIFT), PAGE_SIZE);
+	return copy;
+}
+
+/*
+ * Kernel address of file page "index" or NULL if it has no page. With
+ * alloc set a zeroed page is taken from FILE_STORE_REG the first time
+ * the page is written, and a shared page is copied so that the write
+ * only changes this file.
+ */
+static int zpool_expand(u32 *slot);
+
+static int block_compressed(struct inode *inode, u32 index)
+{
+	u32 *slot = get_block_slot(inode, index, 0);
+	return slot && (*slot & SLOT_COMPRESSED);
+}
+
+static char* get_block(struct inode *inode, u32 index, int alloc)
+{
+	u32 pfn, *slot = get_block_slot(inode, index, alloc);
+	if( !slot )
+		return NULL;
+	if( (*slot & SLOT_COMPRESSED) && zpool_expand(slot) < 0 )
+		return NULL;
+	if( !*slot )
+	{
+		if( !alloc )
+			return NULL;
+		pfn = alloc_store_page();
+		if( !pfn )
+			return NULL;
+		*slot = pfn;
+	}
+	else if( alloc && !page_shares(*slot) )
+	{
+		// about to change in place, it no longer matches its hash
+		dedup_unlink(*slot);
+	}
+	else if( alloc )
+	{
+		pfn = alloc_store_page();
+		if( !pfn )
+			return NULL;
+		memcpy((char *)((u64)pfn << PAGE_SHIFT), (char *)((u64)*slot << PAGE_SHIFT), PAGE_SIZE);
+		put_store_page(*slot);
+		*slot = pfn;
+	}
+	if( super_block->page_tick )
+		super_block->page_tick[*slot - STORE_START_PFN] = stats->ticks;
+	return (char *)((u64)*slot << PAGE_SHIFT);
+}
 
-	for(index = 0; index < NUM_FILES; ++index)
+/* First inode number in use at or after inode_no, MAX_INODES if none */
+static u32 next_used_inode(struct super_block *sb, u32 inode_no)
+{
+	u64 word;
+	while( inode_no < MAX_INODES )
 	{
-		super_block->inode[index] = (struct inode *) inode_pfn;
-		inode_pfn = inode_pfn + sizeof(struct inode);
+		word = sb->inode_bitmap[inode_no / 64] >> (inode_no % 64);
+		if( word )
+		{
+			inode_no += __builtin_ctzll(word);
+			return inode_no < MAX_INODES ? inode_no : MAX_INODES;
+		}
+		// nothing left in this word, skip to the next one
+		inode_no = (inode_no / 64 + 1) * 64;
 	}
-	super_block->sb_op = (struct sb_operations*)os_page_alloc(FILE_DS_REG);
+	return MAX_INODES;
 }
+
 /*
- * start_reg is Starting address of the first usable page of FILE_STORE_REG 
- * file_size is maximum size of the file [in BYTES] we can allocate But for
- * simplicity we rounding the file_size to a PAGE_SIZE*num_pages;
- * Allocation of pages is taking too much time
+ * Compressed tier. Pages that have not been touched for a while can be
+ * compressed (lz.c) into the zpool: FILE_STORE_REG pages cut into
+ * ZPOOL_UNITS units of ZPOOL_UNIT bytes, with a bitmap of used units
+ * per pool page in sb->zpool[]. A compressed block map slot holds
+ * SLOT_COMPRESSED | pool page index << 6 | first unit; the object there
+ * starts with its u16 length. get_block expands the page again on the
+ * next access.
  */
-void alloc_inodes(struct super_block *sb)
-{
-	u32 i, num_pages;
-	u64 start_reg, file_size, file_pfn;
-	start_reg =  get_contigous_pages(FILE_STORE_REG, 1);
-	file_size = (END - start_reg) / NUM_FILES;       
-	num_pages = FILE_SIZE / PAGE_SIZE ;
-	file_size = num_pages * PAGE_SIZE;
-	for( i=0; i<NUM_FILES; i++)
-	{
-		struct inode *inode = sb->inode[i];
-		if( i == 0 )
-		{	// We allocated already 1 page to get start_reg
-			file_pfn = get_contigous_pages(FILE_STORE_REG, num_pages-1);
-			inode->s_pos = start_reg;
-			inode->e_pos = start_reg + file_size;
+static inline u64 rdtsc(void)
+{
+	u32 lo, hi;
+	asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((u64)hi << 32) | lo;
+}
+
+static inline char* zpool_addr(u32 handle)
+{
+	struct zpool_page *zp = &super_block->zpool[(handle & ~SLOT_COMPRESSED) >> 6];
+	return (char *)((u64)zp->pfn << PAGE_SHIFT) + (handle & 63) * ZPOOL_UNIT;
+}
+
+static u64 zpool_mask(u32 units)
+{
+	return units == 64 ? ~0ULL : (1ULL << units) - 1;
+}
+
+/* Returns a handle for size bytes in the pool, 0 on failure */
+static u32 zpool_alloc(struct super_block *sb, u32 size)
+{
+	u32 units = (size + ZPOOL_UNIT - 1) / ZPOOL_UNIT;
+	u32 i, shift, unused = ZPOOL_MAX_PAGES;
+	u64 mask = zpool_mask(units);
+	struct zpool_page *zp;
+
+	for( i=0; i < sb->zpool_used; i++)
+	{
+		zp = &sb->zpool[i];
+		if( !zp->pfn )
+		{
+			if( unused == ZPOOL_MAX_PAGES )
+				unused = i;
+			continue;
 		}
-		else
+		if( zp->free_units < units )
+			continue;
+		for( shift=0; shift + units <= ZPOOL_UNITS; shift++)
+			if( !(zp->bitmap & (mask << shift)) )
+				goto found;
+	}
+	if( unused == ZPOOL_MAX_PAGES )
+	{
+		if( sb->zpool_used == ZPOOL_MAX_PAGES )
+			return 0;
+		unused = sb->zpool_used++;
+	}
+	i = unused;
+	zp = &sb->zpool[i];
+	zp->pfn = get_contigous_pages(FILE_STORE_REG, 1) >> PAGE_SHIFT;
+	if( !zp->pfn )
+		return 0;
+	zp->bitmap = 0;
+	zp->free_units = ZPOOL_UNITS;
+	sb->zpool_pages++;
+	shift = 0;
+found:
+	zp->bitmap |= mask << shift;
+	zp->free_units -= units;
+	return SLOT_COMPRESSED | (i << 6) | shift;
+}
+
+static void zpool_free(struct super_block *sb, u32 handle)
+{
+	struct zpool_page *zp = &sb->zpool[(handle & ~SLOT_COMPRESSED) >> 6];
+	u32 size = *(u16 *)zpool_addr(handle) + sizeof(u16);
+	u32 units = (size + ZPOOL_UNIT - 1) / ZPOOL_UNIT;
+
+	sb->z_pages--;
+	sb->z_bytes -= size;
+	zp->bitmap &= ~(zpool_mask(units) << (handle & 63));
+	zp->free_units += units;
+	if( !zp->bitmap )
+	{
+		put_contigous_pages(FILE_STORE_REG, (u64)zp->pfn << PAGE_SHIFT, 1);
+		zp->pfn = 0;
+		sb->zpool_pages--;
+	}
+}
+
+/* Decompresses the page *slot refers to into a new store page */
+static int zpool_expand(u32 *slot)
+{
+	struct super_block *sb = super_block;
+	char *obj = zpool_addr(*slot);
+	u64 start;
+	u32 pfn = alloc_store_page();
+	if( !pfn )
+		return -1;
+	start = rdtsc();
+	lz_decompress((char *)((u64)pfn << PAGE_SHIFT), obj + sizeof(u16), *(u16 *)obj, PAGE_SIZE);
+	sb->z_decompress_cycles += rdtsc() - start;
+	sb->z_decompressions++;
+	zpool_free(sb, *slot);
+	*slot = pfn;
+	return 0;
+}
+
+/* Moves the page of *slot to the pool if it compresses to half or less */
+static int compress_slot(struct super_block *sb, u32 *slot)
+{
+	static char zbuf[ZPOOL_MAX_OBJECT];
+	int len;
+	u32 handle;
+	char *obj;
+
+	len = lz_compress(zbuf, (char *)((u64)*slot << PAGE_SHIFT), PAGE_SIZE, ZPOOL_MAX_OBJECT - sizeof(u16));
+	if( len < 0 )
+		return 0;
+	handle = zpool_alloc(sb, len + sizeof(u16));
+	if( !handle )
+		return 0;
+	obj = zpool_addr(handle);
+	*(u16 *)obj = len;
+	memcpy(obj + sizeof(u16), zbuf, len);
+	put_store_page(*slot);
+	*slot = handle;
+	sb->z_pages++;
+	sb->z_bytes += len + sizeof(u16);
+	return 1;
+}
+
+/*
+ * Compresses every file page not touched for cold_ticks timer ticks.
+ * Pages shared with other files or in the dedup index are left alone.
+ * Returns the number of pages compressed, -1 if the pool or access
+ * time table could not be allocated.
+ */
+int flat_compress(struct super_block *sb, u32 cold_ticks)
+{
+	u32 inode_no, i, last, *slot, pfn;
+	int count = 0;
+	struct inode *inode;
+
+	if( !sb->zpool )
+	{
+		sb->zpool = (struct zpool_page *)get_contigous_pages(FILE_DS_REG, ZPOOL_MAX_PAGES * sizeof(struct zpool_page) / PAGE_SIZE);
+		if( !sb->zpool )
+			return -1;
+	}
+	// access times are only kept from the first call on
+	if( !sb->page_tick )
+	{
+		if( !store_table((void **)&sb->page_tick, sizeof(u32)) )
+			return -1;
+		for( i=0; i < STORE_PAGES; i++)
+			sb->page_tick[i] = stats->ticks;
+	}
+	for( inode_no = next_used_inode(sb, 0); inode_no < MAX_INODES; inode_no = next_used_inode(sb, inode_no + 1))
+	{
+		inode = get_inode_by_no(sb, inode_no);
+		if( (inode->flags & I_INLINE) || !inode->file_size )
+			continue;
+		last = (inode->file_size - 1) >> PAGE_SHIFT;
+		for( i=0; i <= last; i++)
 		{
-			file_pfn = get_contigous_pages(FILE_STORE_REG, num_pages);
-                        inode->s_pos = file_pfn;
-                        inode->e_pos = file_pfn + file_size;
+			slot = get_block_slot(inode, i, 0);
+			if( !slot )
+				break;
+			pfn = *slot;
+			if( !pfn || (pfn & SLOT_COMPRESSED) || page_shares(pfn) || page_pinned(pfn) )
+				continue;
+			if( sb->dedup_hash && sb->dedup_hash[pfn - STORE_START_PFN] )
+				continue;
+			if( stats->ticks - sb->page_tick[pfn - STORE_START_PFN] < cold_ticks )
+				continue;
+			count += compress_slot(sb, slot);
+		}
+	}
+	return count;
+}
+
+/*
+ * Page dedup. Store pages are indexed by a hash of their contents in
+ * sb->dedup_buckets, chained through sb->dedup_next[]; sb->dedup_hash[]
+ * holds the hash of an indexed page and is 0 for pages not in the index.
+ * A page leaves the index before it is changed in place or freed. The
+ * index is only allocated once dedup is first used.
+ */
+#define DEDUP_BUCKETS 65536
+
+static u32 page_content_hash(u32 pfn)
+{
+	u64 *word = (u64 *)((u64)pfn << PAGE_SHIFT);
+	u64 hash = 0xcbf29ce484222325ULL;
+	u32 i;
+	for( i=0; i < PAGE_SIZE / sizeof(u64); i++)
+		hash = (hash ^ word[i]) * 0x100000001b3ULL;
+	hash ^= hash >> 32;
+	return (u32)hash ? (u32)hash : 1;
+}
+
+static int dedup_init(struct super_block *sb)
+{
+	u32 table_pages = (sizeof(u32) * STORE_PAGES + PAGE_SIZE - 1) / PAGE_SIZE;
+	if( sb->dedup_buckets )
+		return 0;
+	sb->dedup_hash = (u32 *)get_contigous_pages(FILE_DS_REG, table_pages);
+	sb->dedup_next = (u32 *)get_contigous_pages(FILE_DS_REG, table_pages);
+	sb->dedup_buckets = (u32 *)get_contigous_pages(FILE_DS_REG, DEDUP_BUCKETS * sizeof(u32) / PAGE_SIZE);
+	if( !sb->dedup_hash || !sb->dedup_next || !sb->dedup_buckets )
+	{
+		if( sb->dedup_hash )
+			put_contigous_pages(FILE_DS_REG, (u64)sb->dedup_hash, table_pages);
+		if( sb->dedup_next )
+			put_contigous_pages(FILE_DS_REG, (u64)sb->dedup_next, table_pages);
+		if( sb->dedup_buckets )
+			put_contigous_pages(FILE_DS_REG, (u64)sb->dedup_buckets, DEDUP_BUCKETS * sizeof(u32) / PAGE_SIZE);
+		sb->dedup_hash = sb->dedup_next = sb->dedup_buckets = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+static void dedup_unlink(u32 pfn)
+{
+	struct super_block *sb = super_block;
+	u32 *link, index = pfn - STORE_START_PFN;
+	if( !sb->dedup_buckets || !sb->dedup_hash[index] )
+		return;
+	link = &sb->dedup_buckets[sb->dedup_hash[index] % DEDUP_BUCKETS];
+	while( *link != pfn )
+		link = &sb->dedup_next[*link - STORE_START_PFN];
+	*link = sb->dedup_next[index];
+	sb->dedup_hash[index] = 0;
+}
+
+/*
+ * Looks pfn up in the index. Returns an indexed page with the same
+ * contents, or indexes pfn itself and returns it.
+ */
+static u32 dedup_insert(u32 pfn)
+{
+	struct super_block *sb = super_block;
+	u32 hash = page_content_hash(pfn);
+	u32 *bucket = &sb->dedup_buckets[hash % DEDUP_BUCKETS];
+	u32 other = *bucket;
+	while( other )
+	{
+		if( sb->dedup_hash[other - STORE_START_PFN] == hash &&
+		    !memcmp((char *)((u64)other << PAGE_SHIFT), (char *)((u64)pfn << PAGE_SHIFT), PAGE_SIZE) )
+			return other;
+		other = sb->dedup_next[other - STORE_START_PFN];
+	}
+	sb->dedup_hash[pfn - STORE_START_PFN] = hash;
+	sb->dedup_next[pfn - STORE_START_PFN] = *bucket;
+	*bucket = pfn;
+	return pfn;
+}
+
+/* Points *slot at an identical indexed page if there is one */
+static void dedup_slot(u32 *slot)
+{
+	u32 match, copy;
+	if( !*slot || (*slot & SLOT_COMPRESSED) || super_block->dedup_hash[*slot - STORE_START_PFN] || page_pinned(*slot) )
+		return;
+	match = dedup_insert(*slot);
+	if( match == *slot )
+		return;
+	copy = share_store_page(match);
+	if( copy != match )
+	{
+		// count full or no room for the count table, keep our own page
+		if( copy )
+			put_store_page(copy);
+		return;
+	}
+	put_store_page(*slot);
+	*slot = match;
+	super_block->fs_stats.dedup_merges++;
+}
 
+/*
+ * Dedup pass over every file page in the file system. Returns 0, or -1
+ * if the index could not be allocated.
+ */
+int flat_dedup(struct super_block *sb)
+{
+	u32 inode_no, i, last, *slot;
+	struct inode *inode;
+	if( dedup_init(sb) < 0 )
+		return -1;
+	for( inode_no = next_used_inode(sb, 0); inode_no < MAX_INODES; inode_no = next_used_inode(sb, inode_no + 1))
+	{
+		inode = get_inode_by_no(sb, inode_no);
+		if( (inode->flags & I_INLINE) || !inode->file_size )
+			continue;
+		last = (inode->file_size - 1) >> PAGE_SHIFT;
+		for( i=0; i <= last; i++)
+		{
+			slot = get_block_slot(inode, i, 0);
+			if( !slot )
+				break;
+			dedup_slot(slot);
 		}
+	}
+	return 0;
+}
+
+/* Turns write time dedup of full pages in flat_write on or off */
+int flat_dedup_mode(struct super_block *sb, int on)
+{
+	if( on && dedup_init(sb) < 0 )
+		return -1;
+	sb->dedup_mode = on;
+	return 0;
+}
+
+/*
+ * Moves the inline data of inode to a FILE_STORE_REG page and switches it
+ * over to the block map. Returns 0 or -1 when no page is left.
+ */
+static int promote_inline(struct inode *inode)
+{
+	u32 pfn = 0;
+	if( inode->file_size )
+	{
+		pfn = alloc_store_page();
+		if( !pfn )
+			return -1;
+		memcpy((char *)((u64)pfn << PAGE_SHIFT), inode->inline_data, inode->file_size);
+	}
+	bzero(inode->inline_data, INODE_INLINE_SIZE);
+	inode->blocks[0] = pfn;
+	inode->flags &= ~I_INLINE;
+	return 0;
+}
+
+static void free_file_store(struct inode *inode)
+{
+	u32 i, *slot;
+	if( inode->flags & I_INLINE )
+	{
+		bzero(inode->inline_data, INODE_INLINE_SIZE);
+		return;
+	}
+	for( i=0; i < MAX_FILE_BLOCKS; i++)
+	{
+		slot = get_block_slot(inode, i, 0);
+		if( !slot )
+			break;
+		if( *slot & SLOT_COMPRESSED )
+			zpool_free(inode->sb, *slot);
+		else if( *slot )
+			put_store_page(*slot);
+		*slot = 0;
+	}
+	if( inode->indirect )
+		buddy_free(FILE_DS_REG, inode->indirect, 0);
+	inode->indirect = 0;
+	inode->flags = I_INLINE;
+}
+
+void init_file_inode(struct super_block * super_block)
+{
+	u32 table_pages = (sizeof(struct inode *) * MAX_INODE_CHUNKS + PAGE_SIZE - 1) / PAGE_SIZE;
+	u32 hash_pages = (sizeof(struct inode *) * NAME_HASH_SIZE + PAGE_SIZE - 1) / PAGE_SIZE;
+
+	super_block->inode_chunks = (struct inode **)get_contigous_pages(FILE_DS_REG, table_pages);
+	super_block->name_hash = (struct inode **)get_contigous_pages(FILE_DS_REG, hash_pages);
+	super_block->sb_op = (struct sb_operations*)get_contigous_pages(FILE_DS_REG, 1);
+}
+
+/*
+ * Inodes are allocated a page at a time when an inode number in a chunk
+ * that does not exist yet is handed out. No file data is allocated here;
+ * FILE_STORE_REG pages are handed out one at a time the first time
+ * flat_write touches them (see get_block).
+ */
+static struct inode* alloc_inode_chunk(struct super_block *sb, u32 chunk)
+{
+	u32 i;
+	struct inode *inodes = (struct inode *)get_contigous_pages(FILE_DS_REG, 1);
+	if( !inodes )
+		return NULL;
+	for( i=0; i<INODES_PER_CHUNK; i++)
+	{
+		struct inode *inode = &inodes[i];
 		inode->is_valid = 0;
                 inode->filename[0] = '\0';
                 inode->mode = 0;
@@ -79,27 +621,44 @@ void alloc_inodes(struct super_block *sb)
                 inode->open = flat_open;
 		inode->close = flat_close;
 
-		inode->inode_no = i;
-                inode->max_pos = inode->s_pos;
+		inode->inode_no = chunk * INODES_PER_CHUNK + i;
                 inode->file_size = 0;
                 inode->ref_count = 0;
                 inode->sb = sb;
+		inode->hash_next = NULL;
+		inode->flags = I_INLINE;
 	}
+	sb->inode_chunks[chunk] = inodes;
+	return inodes;
+}
+
+struct inode* get_inode_by_no(struct super_block *sb, u32 inode_no)
+{
+	struct inode *chunk;
+	if( inode_no >= MAX_INODES )
+		return NULL;
+	chunk = sb->inode_chunks[inode_no / INODES_PER_CHUNK];
+	if( !chunk )
+		return NULL;
+	return &chunk[inode_no % INODES_PER_CHUNK];
 }
 
 void init_file_system()
 {
 	//struct super_block * super_block;
-	super_block = (struct super_block*)os_page_alloc(FILE_DS_REG);
+	buddy_init(FILE_DS_REG, REGION_FILE_DS_START, REGION_FILE_STORE_START);
+	buddy_init(FILE_STORE_REG, REGION_FILE_STORE_START, ENDMEM);
+	super_block = (struct super_block*)get_contigous_pages(FILE_DS_REG, 1);
+	bzero((char *)super_block, sizeof(struct super_block));
 
 	init_file_inode(super_block);
-	alloc_inodes(super_block);
 
 	super_block->fs_name = "flat";
 	super_block->num_files = 0;
 	super_block->sb_op->remove_inode = flat_remove_inode;
 	super_block->sb_op->create_inode = flat_create_inode;
 	super_block->sb_op->lookup_inode = flat_lookup_inode;
+	super_block->sb_op->clone_inode = flat_clone_inode;
 	super_block->sb_op->get_inode_no = flat_get_inode_no;
 	super_block->sb_op->get_num_files = flat_get_num_files;
 	super_block->sb_op->list_all_files = flat_list_all_files;
@@ -110,7 +669,7 @@ void init_file_system()
 	u32 inode_no;
 	int i, num_files;
 	struct inode *inode;
-	for(i=0; i<=NUM_FILES; i++)
+	for(i=0; i<=MAX_INODES; i++)
 	{
 	file_name[2] = 'a'+i;
 	file_name[3] = '\0';
@@ -168,7 +727,7 @@ void init_file_system()
 
 	}
 
-	for(i = NUM_FILES-1; i>=0 ; i--)
+	for(i = MAX_INODES-1; i>=0 ; i--)
 	{
 	file_name[2] = 'a'+i;
 	file_name[3] = '\0';
@@ -198,88 +757,201 @@ static int is_valid_inode( struct inode *inode )
         return inode->is_valid;
 }
 
+/*
+ * Filename index: every valid inode is chained in sb->name_hash[] by its
+ * filename, so lookup/create/get_inode_no do not scan the inode table.
+ */
+static u32 name_hash(char *name)
+{
+	u32 hash = 5381;
+	while( *name != '\0' )
+	{
+		hash = (hash << 5) + hash + (u8)*name;
+		name++;
+	}
+	return hash % NAME_HASH_SIZE;
+}
+
+static struct inode* hash_lookup(struct super_block *sb, char *filename)
+{
+	struct inode *inode = sb->name_hash[name_hash(filename)];
+	while( inode )
+	{
+		if( is_valid_inode(inode) && strcmp(inode->filename, filename) == 0 )
+			return inode;
+		inode = inode->hash_next;
+	}
+	return NULL;
+}
+
+static void hash_insert(struct super_block *sb, struct inode *inode)
+{
+	u32 bucket = name_hash(inode->filename);
+	if( sb->name_hash[bucket] )
+		sb->fs_stats.hash_collisions++;
+	inode->hash_next = sb->name_hash[bucket];
+	sb->name_hash[bucket] = inode;
+}
+
+static void hash_remove(struct super_block *sb, struct inode *inode)
+{
+	struct inode **link = &sb->name_hash[name_hash(inode->filename)];
+	while( *link )
+	{
+		if( *link == inode )
+		{
+			*link = inode->hash_next;
+			break;
+		}
+		link = &(*link)->hash_next;
+	}
+	inode->hash_next = NULL;
+}
 
 struct inode* flat_lookup_inode(struct super_block *sb, char *filename)
 {
-	u32 i;
-        for( i=0; i< NUM_FILES; i++)
-        {
-                struct inode *inode = sb->inode[i];
-  	   	if( is_valid_inode(inode) && strcmp(inode->filename, filename) == 0 )
-                        return inode;
-        }
-        return NULL;
+	sb->fs_stats.lookups++;
+	return hash_lookup(sb, filename);
 }
 
 int flat_get_inode_no( struct super_block *sb, char *name)
 {
-	u32 i;
-        for( i=0; i< NUM_FILES; i++)
-        {
-                struct inode *inode = sb->inode[i];
-                if( is_valid_inode(inode) && strcmp(inode->filename, name) == 0 )
-                        return i;
-        }
-        return -1;
+	struct inode *inode = hash_lookup(sb, name);
+	if( inode == NULL )
+		return -1;
+	return inode->inode_no;
 }
 
-static int get_free_inode( struct super_block *sb)
+/* Find-first-zero in the inode bitmap, growing the table if needed */
+static struct inode* get_free_inode( struct super_block *sb)
 {
-        u32 i;
-        for(i=0; i<NUM_FILES; i++)
-        {
-                if( !is_valid_inode(sb->inode[i]) )
-                {
-                        return i;
-                }
-        }
-        return -1;
+	u32 word, inode_no;
+	struct inode *inode;
+
+	for( word = sb->free_hint; word < INODE_BITMAP_WORDS; word++)
+	{
+		if( sb->inode_bitmap[word] != ~0ULL )
+			break;
+	}
+	sb->free_hint = word;
+	if( word == INODE_BITMAP_WORDS )
+		return NULL;
+	inode_no = word * 64 + __builtin_ctzll(~sb->inode_bitmap[word]);
+	if( inode_no >= MAX_INODES )
+		return NULL;
+
+	inode = get_inode_by_no(sb, inode_no);
+	if( !inode )
+	{
+		if( !alloc_inode_chunk(sb, inode_no / INODES_PER_CHUNK) )
+			return NULL;
+		inode = get_inode_by_no(sb, inode_no);
+	}
+	sb->inode_bitmap[word] |= 1ULL << (inode_no % 64);
+	return inode;
+}
+
+static void put_free_inode( struct super_block *sb, struct inode *inode)
+{
+	u32 word = inode->inode_no / 64;
+	sb->inode_bitmap[word] &= ~(1ULL << (inode->inode_no % 64));
+	if( word < sb->free_hint )
+		sb->free_hint = word;
 }
 
 
 int flat_create_inode(struct super_block *sb, char *file_name, u32 mode)
 {
-   	u32 inode_no, i=0;
-        inode_no = get_free_inode(sb);
+	struct inode *inode;
+   	u32 i=0;
 	// check if the filename is exits or not [ Upper layers ]
 	if( sb->sb_op->lookup_inode(sb, file_name) != NULL )
 		return -1;
 
-        if( inode_no >= 0 && inode_no < NUM_FILES )
-        {
-                struct inode *inode = sb->inode[inode_no];
-                
-		inode->is_valid = 1;
-                inode->mode = mode;
-		// file_name length should not be 0, check before file is there are not
-                while( file_name[i] != '\0' )
-                {
-                        inode->filename[i] = file_name[i];
-                        i++;
-                }
-		inode->filename[i] = '\0';
-
-                inode->max_pos = inode->s_pos;
-                inode->file_size = 0;
-                inode->ref_count = 0;
-                
-		sb->num_files += 1;
-        }
-	else
+        inode = get_free_inode(sb);
+        if( inode == NULL )
 		return -1;
-        return inode_no;
+
+	inode->is_valid = 1;
+	inode->mode = mode;
+	// file_name length should not be 0, check before file is there are not
+	while( file_name[i] != '\0' )
+	{
+		inode->filename[i] = file_name[i];
+		i++;
+	}
+	inode->filename[i] = '\0';
+
+	inode->file_size = 0;
+	inode->ref_count = 0;
+
+	hash_insert(sb, inode);
+	sb->num_files += 1;
+	sb->fs_stats.creates++;
+        return inode->inode_no;
+}
+
+/*
+ * Creates filename as a clone of src. The new block map points at the
+ * same store pages, each gaining a reference; get_block copies a shared
+ * page on its first write. Returns the new inode number or -1.
+ */
+int flat_clone_inode(struct super_block *sb, struct inode *src, char *filename)
+{
+	struct inode *inode;
+	u32 i, last, *src_slot, *slot;
+	int inode_no = flat_create_inode(sb, filename, src->mode);
+	if( inode_no < 0 )
+		return -1;
+	inode = get_inode_by_no(sb, inode_no);
+
+	if( src->flags & I_INLINE )
+	{
+		memcpy(inode->inline_data, src->inline_data, INODE_INLINE_SIZE);
+		inode->file_size = src->file_size;
+		return inode_no;
+	}
+	inode->flags &= ~I_INLINE;
+	bzero(inode->inline_data, INODE_INLINE_SIZE);
+	last = src->file_size ? (src->file_size - 1) >> PAGE_SHIFT : 0;
+	for( i=0; src->file_size && i <= last; i++)
+	{
+		src_slot = get_block_slot(src, i, 0);
+		if( !src_slot )
+			break;   // no indirect page, the rest is a hole
+		if( !*src_slot )
+			continue;
+		if( (*src_slot & SLOT_COMPRESSED) && zpool_expand(src_slot) < 0 )
+		{
+			flat_remove_inode(sb, inode);
+			return -1;
+		}
+		slot = get_block_slot(inode, i, 1);
+		if( !slot || !(*slot = share_store_page(*src_slot)) )
+		{
+			flat_remove_inode(sb, inode);
+			return -1;
+		}
+	}
+	inode->file_size = src->file_size;
+	return inode_no;
 }
 
 int flat_remove_inode(struct super_block *sb, struct inode *inode)
 {
-	if( !inode && inode->ref_count != 0 )
+	if( !inode || inode->ref_count != 0 )
 		return -1;
 	// file->ref_count should be 0 [ Make sure Upper layers ] 
+	hash_remove(sb, inode);
+	sb->fs_stats.removes++;
         inode->is_valid = 0;
         inode->filename[0] ='\0';
-        inode->max_pos = inode->s_pos;
+	free_file_store(inode);
         inode->file_size = 0;
 	inode->mode = 0;
+	inode->reads = inode->writes = inode->opens = inode->seeks = 0;
+	inode->bytes_read = inode->bytes_written = 0;
+	put_free_inode(sb, inode);
 
         sb->num_files -= 1;
 
@@ -291,58 +963,294 @@ int flat_get_num_files( struct super_block *sb)
 	return sb->num_files;
 }
 
-void flat_list_all_files(struct super_block *sb, void *buf)
+/*
+ * Fills buf with as many dir_entry records as fit in count bytes, starting
+ * at inode number *cookie. *cookie is moved past the last record returned
+ * so the next call resumes there. Returns the bytes filled, 0 once every
+ * file has been listed and -1 if buf cannot hold even one record.
+ */
+int flat_list_all_files(struct super_block *sb, void *buf, int count, u32 *cookie)
 {
-	
+	u32 inode_no, filled = 0, len, rec_len;
+	struct inode *inode;
+	struct dir_entry *dent;
 
+	for( inode_no = next_used_inode(sb, *cookie); inode_no < MAX_INODES; inode_no = next_used_inode(sb, inode_no + 1))
+	{
+		inode = get_inode_by_no(sb, inode_no);
+		len = strlen(inode->filename);
+		rec_len = (sizeof(struct dir_entry) + len + 1 + 7) & ~7;
+		if( filled + rec_len > count )
+		{
+			if( !filled )
+				return -1;
+			break;
+		}
+		dent = (struct dir_entry *)((char *)buf + filled);
+		dent->inode_no = inode_no;
+		dent->file_size = inode->file_size;
+		dent->mode = inode->mode;
+		dent->rec_len = rec_len;
+		dent->name_len = len;
+		memcpy(dent->name, inode->filename, len + 1);
+		filled += rec_len;
+	}
+	*cookie = inode_no;
+	return filled;
+}
+
+/*
+ * Copies the I/O counters of up to count files, from inode number
+ * *cookie on, to buf and moves *cookie past them. Returns the number
+ * of records, 0 when every file has been reported.
+ */
+int flat_inode_stats(struct super_block *sb, struct inode_stats *buf, int count, u32 *cookie)
+{
+	u32 inode_no;
+	int filled = 0;
+	struct inode *inode;
+
+	for( inode_no = next_used_inode(sb, *cookie); inode_no < MAX_INODES && filled < count; inode_no = next_used_inode(sb, inode_no + 1))
+	{
+		inode = get_inode_by_no(sb, inode_no);
+		buf[filled].inode_no = inode_no;
+		buf[filled].file_size = inode->file_size;
+		buf[filled].reads = inode->reads;
+		buf[filled].writes = inode->writes;
+		buf[filled].opens = inode->opens;
+		buf[filled].seeks = inode->seeks;
+		buf[filled].bytes_read = inode->bytes_read;
+		buf[filled].bytes_written = inode->bytes_written;
+		filled++;
+	}
+	*cookie = inode_no;
+	return filled;
 }
 int flat_read(struct inode *inode, char *buf, int count, int *offp)
 {
-	// *offp is  start byte to read from the inode->s_pos
 	/*
-	 * s_pos is inclusive It will read data from s_pos
-	 * max_pos is exclusive means next byte will be written in max_pos
-	 * e_pos is exclusive meeans max_pos can go upto e_pos
-	 * file_size is max_pos - s_pos ; 
+	 * *offp is the byte offset in the file to read from. The data is
+	 * gathered page by page through the block map; a page that was
+	 * never written reads back as zeros.
 	 */
-
-	u64 i, size = 0, s_pos;
-    	
+	u32 done = 0, size, pos, chunk;
+	char *page;
         long int remain_len;
+
 	remain_len = (long int)inode->file_size - *offp;
 	if( remain_len <= 0 )
 		return 0;
 	size = ( count > remain_len ? remain_len : count );
-        s_pos = inode->s_pos;
-	for( i=0 ; i<size ; i++)
+	pos = *offp;
+	if( inode->flags & I_INLINE )
+	{
+		memcpy(buf, inode->inline_data + pos, size);
+		done = size;
+	}
+	while( done < size )
 	{
-		buf[i] = *(char *)(s_pos+ *offp + i);
+		chunk = PAGE_SIZE - (pos & (PAGE_SIZE - 1));
+		if( chunk > size - done )
+			chunk = size - done;
+		page = get_block(inode, pos >> PAGE_SHIFT, 0);
+		if( page )
+			memcpy(buf + done, page + (pos & (PAGE_SIZE - 1)), chunk);
+		else if( block_compressed(inode, pos >> PAGE_SHIFT) )
+			break;   // no page to expand it into
+		else
+			bzero(buf + done, chunk);
+		done += chunk;
+		pos += chunk;
 	}
+	if( !done && size )
+		return -1;
 
-	return size;
+	// reads at or past the end moved no data and are not counted
+	if( done )
+	{
+		inode->reads++;
+		inode->bytes_read += done;
+	}
+	return done;
 }
 
 int flat_write(struct inode *inode, char *buf, int count, int *offp)
 {
-	u64 i, size, s_pos;
-
-	long int max_len;
-        max_len = (long int)inode->e_pos - *offp - (long int)inode->s_pos;
+	u32 done = 0, pos, chunk;
+	char *page;
 
-	if( count > max_len )
+	if( count < 0 || *offp < 0 || (u64)*offp + count > MAX_FILE_SIZE )
 	{
 		return -1; // file_size exceeded
 	}
-        s_pos = inode->s_pos;
-        for( i=0 ; i<count ; i++)
-        {
-		*(char *)(s_pos + *offp + i) = buf[i];
-        }
+	pos = *offp;
+	if( inode->flags & I_INLINE )
+	{
+		if( pos + count <= INODE_INLINE_SIZE )
+		{
+			memcpy(inode->inline_data + pos, buf, count);
+			done = count;
+			pos += count;
+		}
+		else if( promote_inline(inode) < 0 )
+			return -1;
+	}
+	while( done < count )
+	{
+		chunk = PAGE_SIZE - (pos & (PAGE_SIZE - 1));
+		if( chunk > count - done )
+			chunk = count - done;
+		page = get_block(inode, pos >> PAGE_SHIFT, 1);
+		if( !page )
+			break;   // out of file store
+		memcpy(page + (pos & (PAGE_SIZE - 1)), buf + done, chunk);
+		if( chunk == PAGE_SIZE && super_block->dedup_mode )
+			dedup_slot(get_block_slot(inode, pos >> PAGE_SHIFT, 0));
+		done += chunk;
+		pos += chunk;
+	}
+	if( !done && count )
+		return -1;
+
+	if( pos > inode->file_size )
+		inode->file_size = pos;
+	// like reads, only writes that stored data are counted
+	if( done )
+	{
+		inode->writes++;
+		inode->bytes_written += done;
+	}
+        return done;
+}
+
+/*
+ * SEEK_DATA (data set) and SEEK_HOLE helper. A file page without a store
+ * page is a hole; inline files are all data. Returns the first offset at
+ * or after offset that is data (or hole), the end of the file counting
+ * as a hole, or -1 when there is no more data.
+ */
+long flat_seek_hole(struct inode *inode, long offset, int data)
+{
+	u32 index, last, *slot;
+
+	if( offset < 0 || offset >= inode->file_size )
+		return -1;
+	if( inode->flags & I_INLINE )
+		return data ? offset : inode->file_size;
+
+	index = offset >> PAGE_SHIFT;
+	last = (inode->file_size - 1) >> PAGE_SHIFT;
+	for( ; index <= last; index++)
+	{
+		slot = get_block_slot(inode, index, 0);
+		if( (slot && *slot) == data )
+			break;
+	}
+	if( index > last )
+		return data ? -1 : inode->file_size;
+	if( index == offset >> PAGE_SHIFT )
+		return offset;
+	return (long)index << PAGE_SHIFT;
+}
+
+/*
+ * Direct access to file data for sendfile and splice, which move data
+ * between a file and another file or a pipe without a bounce buffer.
+ * Sets *data to the kernel address of byte pos and *len to the bytes
+ * that follow it in the same page (or inline area). To read, *len stops
+ * at the end of the file and *data is NULL in a hole. To write, the page
+ * is allocated or made private as in flat_write; flat_io_done then
+ * accounts the transfer. Returns 0, or -1 at the end of the file when
+ * reading or when no page is left.
+ */
+int flat_file_data(struct inode *inode, u32 pos, int write, char **data, u32 *len)
+{
+	u32 end = write ? MAX_FILE_SIZE : inode->file_size;
+
+	if( pos >= end )
+		return -1;
+	if( (inode->flags & I_INLINE) && (!write || pos < INODE_INLINE_SIZE) )
+	{
+		*data = inode->inline_data + pos;
+		*len = (write ? INODE_INLINE_SIZE : end) - pos;
+		return 0;
+	}
+	if( (inode->flags & I_INLINE) && promote_inline(inode) < 0 )
+		return -1;
+	*data = get_block(inode, pos >> PAGE_SHIFT, write);
+	if( !*data && block_compressed(inode, pos >> PAGE_SHIFT) )
+		return -1;
+	if( *data )
+		*data += pos & (PAGE_SIZE - 1);
+	*len = PAGE_SIZE - (pos & (PAGE_SIZE - 1));
+	if( *len > end - pos )
+		*len = end - pos;
+	return 0;
+}
+
+void flat_io_done(struct inode *inode, u32 pos, u32 count, int write)
+{
+	if( !count )
+		return;
+	if( !write )
+	{
+		inode->reads++;
+		inode->bytes_read += count;
+		return;
+	}
+	inode->writes++;
+	inode->bytes_written += count;
+	if( pos + count > inode->file_size )
+		inode->file_size = pos + count;
+}
 
-	if( inode->s_pos + *offp + count > inode->max_pos )
-		inode->max_pos = inode->s_pos + *offp + count;
-	inode->file_size = inode->max_pos - inode->s_pos;
-        return count;
+/*
+ * Store pages mapped into a user address space (see do_mmap_file) are
+ * pinned: they are not compressed, merged by dedup or shared by a clone,
+ * and stay allocated until the last mapping goes away even if the file
+ * is removed first.
+ */
+int flat_pin_page(u32 pfn)
+{
+	u16 *pins = store_table((void **)&super_block->page_pins, sizeof(u16));
+	if( !pins || pins[pfn - STORE_START_PFN] == PIN_MAX )
+		return -1;
+	pins[pfn - STORE_START_PFN]++;
+	return 0;
+}
+
+void flat_unpin_page(u32 pfn)
+{
+	u16 *pin = &super_block->page_pins[pfn - STORE_START_PFN];
+	if( --*pin == PIN_ORPHAN )
+	{
+		// the file let go of the page while it was mapped
+		*pin = 0;
+		dedup_unlink(pfn);
+		buddy_free(FILE_STORE_REG, pfn, 0);
+	}
+}
+
+/*
+ * Pins and returns the store pfn of page index of inode, to be mapped.
+ * Inline data is moved to a store page, holes get a zeroed page and
+ * shared or compressed pages are made private, so that the mapping and
+ * flat_read/flat_write see the same page. Returns -1 if no page is left.
+ */
+long flat_map_page(struct inode *inode, u32 index)
+{
+	char *page;
+	u32 pfn;
+
+	if( (inode->flags & I_INLINE) && promote_inline(inode) < 0 )
+		return -1;
+	page = get_block(inode, index, 1);
+	if( !page )
+		return -1;
+	pfn = (u64)page >> PAGE_SHIFT;
+	if( flat_pin_page(pfn) < 0 )
+		return -1;
+	return pfn;
 }
 
 static int get_inode(struct inode *inode)
@@ -378,5 +1286,5 @@ struct inode *create_inode (char *filename, u64 mode)
 	int inode_num = super_block->sb_op->create_inode(super_block, filename, mode);
 	if(inode_num < 0)
 		return NULL; 
-	return super_block->inode[inode_num]; 
+	return get_inode_by_no(super_block, inode_num); 
 }
@@ -33,6 +33,20 @@
 #define SYSCALL_CLOSE       29
 #define SYSCALL_LSEEK       30
 #define SYSCALL_SENDFILE    38
+#define SYSCALL_GETDENTS    39
+#define SYSCALL_FCLONE      40
+#define SYSCALL_FDEDUP      41
+#define SYSCALL_FCOMPRESS   42
+#define SYSCALL_FSSTATS     43
+#define SYSCALL_READV       44
+#define SYSCALL_WRITEV      45
+#define SYSCALL_PREAD       46
+#define SYSCALL_PWRITE      47
+#define SYSCALL_MMAP_FILE   48
+#define SYSCALL_SPLICE      49
+#define SYSCALL_TEE         50
+#define SYSCALL_IO_SETUP    51
+#define SYSCALL_IO_ENTER    52
 #define SYSCALL_CREATE_MSG_QUEUE 31
 #define SYSCALL_GET_MEMBER_INFO 32
 #define SYSCALL_GET_MSG_COUNT 33
@@ -78,6 +92,55 @@ struct os_configs{
 
 extern struct os_configs *config;
 
+/*
+ * Submission/completion ring shared by a process and the kernel, see
+ * io_setup and io_enter. The process fills sqes[sq_tail % IO_RING_ENTRIES]
+ * and bumps sq_tail; io_enter runs the queued operations from sq_head on
+ * and posts one cqe each, bumping cq_tail. The process reaps cqes from
+ * cq_head. Heads and tails only grow. A ring set up with IO_SETUP_TICK
+ * is also drained at each timer tick that finds the process running, so
+ * it can submit without any system call.
+ */
+#define IO_RING_ENTRIES 64
+#define IO_SETUP_TICK 1
+
+enum{
+	IO_OP_NOP,
+	IO_OP_READ,        // fd, addr = buffer, len = count
+	IO_OP_WRITE,       // fd, addr = buffer, len = count
+	IO_OP_LSEEK,       // fd, off = offset, len = whence
+	IO_OP_OPEN,        // addr = filename, len = flags, off = mode
+	IO_OP_CLOSE,       // fd
+	IO_OP_PREAD,       // fd, addr = buffer, len = count, off = offset
+	IO_OP_PWRITE,      // fd, addr = buffer, len = count, off = offset
+	IO_OP_MSG_SEND,    // fd, addr = message
+	IO_OP_MSG_RCV,     // fd, addr = message
+	MAX_IO_OP,
+};
+
+struct io_sqe{
+	u32 opcode;
+	int fd;
+	u64 addr;
+	u64 len;
+	long off;
+	u64 user_data;     // copied to the cqe
+};
+
+struct io_cqe{
+	u64 user_data;
+	long res;          // what the system call would have returned
+};
+
+struct io_ring{
+	u32 sq_head;
+	u32 sq_tail;
+	u32 cq_head;
+	u32 cq_tail;
+	struct io_sqe sqes[IO_RING_ENTRIES];
+	struct io_cqe cqes[IO_RING_ENTRIES];
+};
+
 extern long do_syscall(int syscall, u64 param1, u64 param2, u64 param3, u64 param4);
 extern int handle_div_by_zero(struct user_regs *regs);
 extern int handle_page_fault(struct user_regs *regs);
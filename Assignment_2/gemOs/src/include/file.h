@@ -14,6 +14,10 @@
 #define CREATE_WRITE O_WRITE
 #define CREATE_EXEC O_EXEC
 
+// Descriptors per process; the first MAX_OPEN_FILES live in exec_context
+#define MAX_FDS 512
+#define FD_MAP_WORDS (MAX_FDS / 64)
+
 
 enum{
 	STDIN,
@@ -29,6 +33,8 @@ enum{
 	SEEK_SET,
 	SEEK_CUR,
 	SEEK_END,
+	SEEK_DATA,   // next offset backed by data
+	SEEK_HOLE,   // next offset inside a hole (or EOF)
 	MAX_SEEK,
 };
 
@@ -38,11 +44,18 @@ struct file{
 	u32 offp;
 	u32 ref_count;
 	struct inode * inode;
-	struct fileops * fops;
+	const struct fileops * fops;
 	struct pipe_info * pipe;
 	struct msg_queue_info *msg_queue;
 };
 
+/* One buffer of a readv/writev call */
+struct iovec{
+	void *iov_base;
+	u64 iov_len;
+};
+#define MAX_IOVEC 64
+
 struct fileops{
 	int (*read)(struct file *filep, char * buff, u32 count);
 	int (*write)(struct file *filep, char * buff, u32 count); //seek implementation
@@ -56,11 +69,35 @@ extern void *alloc_memory_buffer();
 extern struct file* create_standard_IO(int);
 extern int open_standard_IO(struct exec_context *ctx, int type);
 extern void do_file_exit(struct exec_context *ctx);
+extern void do_file_fork(struct exec_context *child, struct exec_context *parent);
+// File descriptor table
+extern struct file *get_file(struct exec_context *ctx, int fd);
+extern int install_fd(struct exec_context *ctx, int fd, struct file *filep);
+extern int alloc_fd(struct exec_context *ctx, int from, struct file *filep);
+// Pipes, and sleeping in read/write
+extern int open_pipe(struct exec_context *ctx, int *fd);
+extern void file_wait(struct exec_context *ctx, int fd, u32 count, int write);
 //Reg file read and writ
 extern int do_regular_file_open(struct exec_context *ctx, char *filename, u64 flags, u64 mode);
 extern long do_file_close(struct file *filep);
 // Dup, Dup2
 extern int fd_dup2(struct exec_context *current, int oldfd, int newfd);
 extern long std_close(struct file *filep);
+extern int do_pread_regular(struct file *filep, char *buff, u32 count, long offset);
+extern int do_pwrite_regular(struct file *filep, char *buff, u32 count, long offset);
 extern int do_sendfile(struct exec_context *ctx, int outfd, int infd, long *offset, int count); 
+extern int do_getdents(struct exec_context *ctx, void *buf, int count, u32 *cookie);
+extern int do_fclone(struct exec_context *ctx, char *src, char *dst);
+extern long do_fdedup(struct exec_context *ctx, int cmd);
+struct fcompress_stats;
+struct fs_stats;
+struct inode_stats;
+extern int do_fcompress(struct exec_context *ctx, int cold_ticks, struct fcompress_stats *st);
+extern int do_fsstats(struct exec_context *ctx, struct fs_stats *st, struct inode_stats *buf, int count, u32 *cookie);
+extern int do_splice(struct exec_context *ctx, int fd_in, int fd_out, int len);
+extern int do_tee(struct exec_context *ctx, int fd_in, int fd_out, int len);
+extern long do_mmap_file(struct exec_context *ctx, int fd, long offset, int length, int prot);
+extern void do_file_munmap(struct exec_context *ctx, u64 addr, int length);
+extern void do_file_mmap_fork(struct exec_context *child, struct exec_context *parent);
+extern void do_file_mmap_exit(struct exec_context *ctx);
 #endif
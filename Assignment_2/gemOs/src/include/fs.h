@@ -1,10 +1,97 @@
 #ifndef __FS_H_
 #define __FS_H_
+#include<memory.h>
 
-#define NUM_FILES 32
 #define END 0x80000000
-// #define FILE_SIZE 0x10// 16KB
-#define FILE_SIZE 0x1000 // In Bytes
+
+/*
+ * File data lives in FILE_STORE_REG pages found through a block map:
+ * INODE_DIRECT_BLOCKS page numbers in the inode, then one FILE_DS_REG
+ * page of BLOCKS_PER_INDIRECT further page numbers. 0 means no page.
+ */
+#define INODE_DIRECT_BLOCKS 12
+#define BLOCKS_PER_INDIRECT (PAGE_SIZE / sizeof(u32))
+#define MAX_FILE_BLOCKS (INODE_DIRECT_BLOCKS + BLOCKS_PER_INDIRECT)
+#define MAX_FILE_SIZE (MAX_FILE_BLOCKS * PAGE_SIZE) // In Bytes
+
+/*
+ * Small files keep their data inline in the inode, in the space of the
+ * block map, while I_INLINE is set. They move to FILE_STORE_REG pages
+ * when a write goes past INODE_INLINE_SIZE. The size keeps struct inode
+ * at 512 bytes.
+ */
+#define INODE_INLINE_SIZE 148
+#define I_INLINE 0x1
+
+/*
+ * The inode table grows a page (INODES_PER_CHUNK inodes) at a time, up to
+ * MAX_INODE_CHUNKS pages. Inode numbers in use are tracked in a bitmap.
+ */
+#define INODES_PER_CHUNK (PAGE_SIZE / sizeof(struct inode))
+#define MAX_INODE_CHUNKS 1024
+#define MAX_INODES (MAX_INODE_CHUNKS * INODES_PER_CHUNK)
+#define INODE_BITMAP_WORDS ((MAX_INODES + 63) / 64)
+#define NAME_HASH_SIZE 4096 // filename hash buckets
+
+/* fdedup commands */
+#define DEDUP_RUN 0    // dedup pass over all files
+#define DEDUP_ON  1    // dedup full pages at write time
+#define DEDUP_OFF 2
+
+/*
+ * Compressed pages live in a pool of store pages cut in 64 byte units,
+ * a slot refers to one with SLOT_COMPRESSED set (store pfns never have
+ * bit 31 set). Only pages that compress to half a page are kept.
+ */
+#define SLOT_COMPRESSED 0x80000000
+#define ZPOOL_UNIT 64
+#define ZPOOL_UNITS (PAGE_SIZE / ZPOOL_UNIT)
+#define ZPOOL_MAX_PAGES 4096
+#define ZPOOL_MAX_OBJECT (PAGE_SIZE / 2)
+
+/* fsstats: file system wide counters */
+struct fs_stats{
+	u64 num_files;
+	u64 lookups;
+	u64 creates;
+	u64 removes;
+	u64 hash_collisions;      // creates that landed in a used name bucket
+	u64 shared_bytes;         // bytes saved by shared store pages
+	u64 dedup_merges;
+};
+
+/* fsstats: counters of one file */
+struct inode_stats{
+	u32 inode_no;
+	u32 file_size;
+	u32 reads;
+	u32 writes;
+	u32 opens;
+	u32 seeks;
+	u64 bytes_read;
+	u64 bytes_written;
+};
+
+struct fcompress_stats{
+	u64 compressed_pages;     // file pages held compressed
+	u64 compressed_bytes;     // bytes they take in the pool
+	u64 pool_pages;           // store pages used by the pool
+	u64 decompressions;
+	u64 decompress_cycles;    // total rdtsc cycles spent decompressing
+};
+
+struct zpool_page{
+	u32 pfn;            // 0 if the entry is unused
+	u32 free_units;
+	u64 bitmap;         // used units
+};
+
+/* Store pages shared between files carry a reference count */
+#define STORE_START_PFN (REGION_FILE_STORE_START >> PAGE_SHIFT)
+#define STORE_PAGES ((ENDMEM - REGION_FILE_STORE_START) >> PAGE_SHIFT)
+#define STORE_REF_MAX 0xffff
+#define PIN_MAX 0x7fff
+#define PIN_ORPHAN 0x8000   // pinned page no file points at any more
 
 
 struct inode{
@@ -14,11 +101,23 @@ struct inode{
 	u32 type;
 	u32 inode_no;
 	u32 ref_count;
-	unsigned int s_pos;     //starting position of file
-	unsigned int e_pos;     //ending position of file[ Max_File_Size]
-	unsigned int max_pos;   // ending position of file data
 	unsigned int file_size;  // file_size
+	union{
+		struct{
+			u32 blocks[INODE_DIRECT_BLOCKS];  // pfns of the first file pages
+			u32 indirect;           // pfn of the indirect block page
+		};
+		char inline_data[INODE_INLINE_SIZE];  // file data while I_INLINE
+	};
+	u32 flags;
+	u32 reads;              // I/O counters, see fsstats
+	u32 writes;
+	u32 opens;
+	u32 seeks;
+	u64 bytes_read;
+	u64 bytes_written;
 	struct super_block *sb;
+	struct inode *hash_next;  // next inode in the name hash chain
 
 	int (*read) (struct inode *inode, char *buf, int count, int *offp);
 	int (*write) (struct inode *inode, char *buf, int count, int *offp);
@@ -30,34 +129,81 @@ struct inode{
 struct super_block{
 	int num_files;
 	char *fs_name;		//Name
-	struct inode* inode[NUM_FILES];
+	struct inode** inode_chunks;  // MAX_INODE_CHUNKS pages of inodes, NULL until used
+	struct inode** name_hash;     // NAME_HASH_SIZE filename -> inode chains
+	u64 inode_bitmap[INODE_BITMAP_WORDS];  // bit set: inode number in use
+	u32 free_hint;                // words below this one have no free inode
+	struct fs_stats fs_stats;     // counters reported by fsstats
+	u16 *page_refs;               // users past the first of each store page, NULL until a page is shared
+	u16 *page_pins;               // user mappings of each store page, NULL until a page is mapped
+	u32 *dedup_buckets;           // content hash -> indexed store page
+	u32 *dedup_hash;              // hash of each indexed store page, 0 if not
+	u32 *dedup_next;              // bucket chains
+	u32 dedup_mode;               // dedup full pages as flat_write fills them
+	u32 *page_tick;               // stats->ticks at the last access of each store page, from the first fcompress
+	struct zpool_page *zpool;     // compressed page pool, see flat_compress
+	u32 zpool_used;               // zpool[] entries ever used
+	u64 zpool_pages;              // store pages held by the pool
+	u64 z_pages;                  // file pages held compressed
+	u64 z_bytes;                  // bytes they take in the pool
+	u64 z_decompressions;
+	u64 z_decompress_cycles;
 	struct sb_operations *sb_op;
 };
 
 
+/*
+ * Record filled in by list_all_files. Records are packed back to back,
+ * rec_len is the distance to the next one (8 byte aligned) and name is
+ * NUL terminated.
+ */
+struct dir_entry{
+	u32 inode_no;
+	u32 file_size;
+	u32 mode;
+	u16 rec_len;
+	u16 name_len;
+	char name[];
+};
+
 struct sb_operations{
 	int (*remove_inode) (struct super_block *sb, struct inode *inode);
 	int (*create_inode) (struct super_block *sb, char *filename, u32 mode);
 	struct inode* (*lookup_inode) (struct super_block *sb, char *filename);
 	int (*get_inode_no) ( struct super_block *sb, char *name);
 	int (*get_num_files) (struct super_block *sb);
-	void (*list_all_files) (struct super_block *sb, void *buf );
+	int (*list_all_files) (struct super_block *sb, void *buf, int count, u32 *cookie);
+	int (*clone_inode) (struct super_block *sb, struct inode *src, char *filename);
 };
 
 extern int flat_create_inode(struct super_block *sb, char *filename, u32 mode);
 int flat_remove_inode(struct super_block *sb, struct inode *inode);
+int flat_clone_inode(struct super_block *sb, struct inode *src, char *filename);
+int flat_dedup(struct super_block *sb);
+int flat_dedup_mode(struct super_block *sb, int on);
+int flat_compress(struct super_block *sb, u32 cold_ticks);
+int flat_inode_stats(struct super_block *sb, struct inode_stats *buf, int count, u32 *cookie);
 struct inode* flat_lookup_inode(struct super_block *sb, char *filename);
 int flat_get_inode_no( struct super_block *sb, char *name);
 int flat_get_num_files( struct super_block *sb);
-void flat_list_all_files (struct super_block *sb, void *buf );
+int flat_list_all_files (struct super_block *sb, void *buf, int count, u32 *cookie);
 
 
 int flat_read(struct inode *inode, char *buf, int count, int *offp);
 int flat_write(struct inode *inode, char *buf, int count, int *offp);
+long flat_seek_hole(struct inode *inode, long offset, int data);
+int flat_file_data(struct inode *inode, u32 pos, int write, char **data, u32 *len);
+void flat_io_done(struct inode *inode, u32 pos, u32 count, int write);
+long flat_map_page(struct inode *inode, u32 index);
+int flat_pin_page(u32 pfn);
+void flat_unpin_page(u32 pfn);
 int flat_open(struct inode* inode);
 int flat_close(struct inode *inode);
 
 struct super_block * get_superblock();
+struct inode* get_inode_by_no(struct super_block *sb, u32 inode_no);
+u64 get_contigous_pages(u32 region, int number_of_pages);
+void put_contigous_pages(u32 region, u64 address, int number_of_pages);
 
 extern void init_file_system();
 extern struct inode* lookup_inode(char *filename);
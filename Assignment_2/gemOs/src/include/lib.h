@@ -23,7 +23,11 @@ extern void bzero(char *,int);
 extern char* strcat(char *,char *);
 extern int strcmp(char *,char *);
 extern int memcmp(char *,char *,u32);
-extern int memcpy(char *,char *,u32);
+extern int memcpy(char *,char *,u32);   // lib.o, still used by the prebuilt objects
+extern void fast_memcpy(char *,char *,u32);
+#define memcpy(dest, src, size) fast_memcpy(dest, src, size)   // copy.c for everything built here
+extern int lz_compress(char *dst, char *src, u32 size, u32 max);
+extern int lz_decompress(char *dst, char *src, u32 len, u32 max);
 
 extern void print_user(char *, int);
 //extern int printf(char *,...);
@@ -71,6 +71,17 @@ struct osalloc_chunk{
 	char bitmap[16];   /*current page bitmap*/
 }; 
 
+/* Buddy allocator zone, see buddy.c */
+#define BUDDY_MAX_ORDER 9   /* 2^9 pages = 2MB */
+
+struct buddy_zone{
+	u32 start_pfn;
+	u32 num_pages;
+	u32 free_pages;
+	u8 *page_order;
+	u32 free_head[BUDDY_MAX_ORDER + 1];
+};
+
 #define NODE_MEM_PAGES 100
 
 struct nodealloc_memory{
@@ -107,5 +118,9 @@ extern void os_page_free(u32, void *);
 extern struct node *node_alloc(void);
 extern void node_free(struct node *);
 extern int get_free_pages_region(u32);
+extern void buddy_init(u32 region, u64 start, u64 end);
+extern u32 buddy_alloc(u32 region, u32 order);
+extern void buddy_free(u32 region, u32 pfn, u32 order);
+extern u32 buddy_free_pages(u32 region);
 void *osmap(u64);
 #endif
@@ -19,9 +19,9 @@ struct pipe_info{
 };
 
 
-/*int pipe_read(struct file *filep, char * buff, u32 count);
-int pipe_write(struct file *filep, char * buff, u32 count);
-int pipe_close(struct file *filep);*/
+extern int pipe_read(struct file *filep, char * buff, u32 count);
+extern int pipe_write(struct file *filep, char * buff, u32 count);
+extern int pipe_close(struct file *filep);
 extern int create_pipe(struct exec_context *current, int *fd);
 
 #endif
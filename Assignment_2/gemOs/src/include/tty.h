@@ -0,0 +1,26 @@
+#ifndef __TTY_H_
+#define __TTY_H_
+
+#include <types.h>
+#include <wait.h>
+
+#define TTY_RAW_SIZE 256   /* scancodes waiting to be cooked, power of 2 */
+#define TTY_LINE_MAX 256   /* longest line the line discipline assembles */
+
+struct tty{
+	u8 raw[TTY_RAW_SIZE];
+	u32 raw_head;           /* next scancode to cook */
+	u32 raw_tail;           /* next free raw slot */
+	char line[TTY_LINE_MAX];
+	u32 line_len;           /* bytes in line */
+	u32 read_pos;           /* bytes of a finished line already read */
+	u8 line_done;           /* line ends with '\n' (or is full) */
+	u8 status;              /* shift and caps state, see kbd.h */
+};
+
+extern struct wait_queue tty_wait;
+
+extern void tty_tick(void);
+extern int tty_ready(void);
+extern int tty_read(char *buff, u32 count);
+#endif
@@ -0,0 +1,19 @@
+#ifndef __WAIT_H_
+#define __WAIT_H_
+
+#include <types.h>
+#include <context.h>
+
+/*
+ * Contexts parked in WAITING until a producer calls wake_up. The system
+ * call of a waiter is rewound, so once woken it runs again and checks
+ * its condition itself; a wake up that lost the race costs one retry.
+ */
+struct wait_queue{
+	u32 waiters;    /* bitmap of parked pids */
+};
+
+extern void wait_event(struct wait_queue *wq, u32 ticks);
+extern void wake_up(struct wait_queue *wq);
+extern void wait_clear(struct exec_context *ctx);
+#endif
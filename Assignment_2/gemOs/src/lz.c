@@ -0,0 +1,109 @@
+#include<types.h>
+#include<lib.h>
+
+/*
+ * Small LZ77 codec used to compress cold file store pages. The output is
+ * a list of runs, each starting with a control byte:
+ *   0x00 - 0x7f  literal run of (c + 1) bytes, the bytes follow
+ *   0x80 - 0xff  match of (c & 0x7f) + LZ_MIN_MATCH bytes, followed by a
+ *                2 byte little endian distance back into the output
+ * Matches are found through a hash table of the last position of every
+ * 3 byte prefix, so compression is a single pass over the input.
+ */
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH (0x7f + LZ_MIN_MATCH)
+#define LZ_MAX_LITERAL 0x80
+#define LZ_HASH_BITS 12
+
+static u16 lz_table[1 << LZ_HASH_BITS];
+
+static inline u32 lz_hash(u8 *p)
+{
+	u32 v = p[0] | (p[1] << 8) | (p[2] << 16);
+	return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static int lz_flush_literals(u8 *out, u32 *op, u32 max, u8 *lit, u32 count)
+{
+	u32 run;
+	while(count){
+		run = count > LZ_MAX_LITERAL ? LZ_MAX_LITERAL : count;
+		if(*op + 1 + run > max)
+			return -1;
+		out[(*op)++] = run - 1;
+		memcpy((char *)out + *op, (char *)lit, run);
+		*op += run;
+		lit += run;
+		count -= run;
+	}
+	return 0;
+}
+
+/*
+ * Compresses size (less than 64KB) bytes of src into dst. Returns the
+ * compressed length, or -1 if it would not fit in max bytes.
+ */
+int lz_compress(char *dst, char *src, u32 size, u32 max)
+{
+	u8 *in = (u8 *)src, *out = (u8 *)dst;
+	u32 ip = 0, op = 0, lit = 0, cand, len, h;
+
+	for(h = 0; h < (1 << LZ_HASH_BITS); h++)
+		lz_table[h] = 0xffff;
+	while(ip + LZ_MIN_MATCH <= size){
+		h = lz_hash(in + ip);
+		cand = lz_table[h];
+		lz_table[h] = ip;
+		if(cand == 0xffff || in[cand] != in[ip] || in[cand + 1] != in[ip + 1] || in[cand + 2] != in[ip + 2]){
+			ip++;
+			continue;
+		}
+		len = LZ_MIN_MATCH;
+		while(len < LZ_MAX_MATCH && ip + len < size && in[cand + len] == in[ip + len])
+			len++;
+		if(lz_flush_literals(out, &op, max, in + lit, ip - lit) < 0 || op + 3 > max)
+			return -1;
+		out[op++] = 0x80 | (len - LZ_MIN_MATCH);
+		out[op++] = (ip - cand) & 0xff;
+		out[op++] = (ip - cand) >> 8;
+		ip += len;
+		lit = ip;
+	}
+	if(lz_flush_literals(out, &op, max, in + lit, size - lit) < 0)
+		return -1;
+	return op;
+}
+
+/* Expands src (len bytes) into dst. Returns the output length or -1 */
+int lz_decompress(char *dst, char *src, u32 len, u32 max)
+{
+	u8 *in = (u8 *)src, *out = (u8 *)dst;
+	u32 ip = 0, op = 0, run, dist;
+	u8 c;
+
+	while(ip < len){
+		c = in[ip++];
+		if(c < 0x80){
+			run = c + 1;
+			if(ip + run > len || op + run > max)
+				return -1;
+			memcpy((char *)out + op, (char *)in + ip, run);
+			ip += run;
+			op += run;
+			continue;
+		}
+		run = (c & 0x7f) + LZ_MIN_MATCH;
+		if(ip + 2 > len)
+			return -1;
+		dist = in[ip] | (in[ip + 1] << 8);
+		ip += 2;
+		if(!dist || dist > op || op + run > max)
+			return -1;
+		// byte by byte, the match may overlap what it produces
+		while(run--){
+			out[op] = out[op - dist];
+			op++;
+		}
+	}
+	return op;
+}
@@ -0,0 +1,132 @@
+#include<types.h>
+#include<lib.h>
+#include<kbd.h>
+#include<tty.h>
+#include<wait.h>
+
+/*
+ * Console line discipline. The prebuilt IDT routes no keyboard IRQ, so
+ * the timer tick stands in for it: tty_tick drains the keyboard
+ * controller into a raw ring and cooks the ring into one line at a time
+ * (echo, backspace, shift and caps). Reads only hand out bytes once the
+ * line is finished with a newline; a reader with nothing to read sleeps
+ * on tty_wait until tty_tick finishes a line.
+ */
+static struct tty console;
+
+/* readers waiting for a line, woken once one is finished */
+struct wait_queue tty_wait;
+
+static void tty_poll(void)
+{
+	struct tty *tty = &console;
+
+	while(inb(KBD_CTRL_PORT) & (1 << KBD_CDATA_BIT)){
+		u8 sc = inb(KBD_DATA_PORT);
+		if(tty->raw_tail - tty->raw_head == TTY_RAW_SIZE)
+			continue;   // ring full, drop the key
+		tty->raw[tty->raw_tail++ & (TTY_RAW_SIZE - 1)] = sc;
+	}
+}
+
+/* Returns the character for a scancode, or 0 for modifiers and releases */
+static char tty_translate(struct tty *tty, u8 sc)
+{
+	char c;
+
+	if(sc & 0x80){
+		if(sc == SC_LSFT_REL)
+			tty->status &= ~(1 << LSHIFT);
+		else if(sc == SC_RSFT_REL)
+			tty->status &= ~(1 << RSHIFT);
+		return 0;
+	}
+	switch(sc){
+	case SC_CAPS:
+		tty->status ^= 1 << CAPS_ON;
+		return 0;
+	case SC_LSFT:
+		tty->status |= 1 << LSHIFT;
+		return 0;
+	case SC_RSFT:
+		tty->status |= 1 << RSHIFT;
+		return 0;
+	}
+	if(tty->status & (1 << LSHIFT | 1 << RSHIFT))
+		return kbmap_upper[sc];
+	c = kbmap_base[sc];
+	if((tty->status & (1 << CAPS_ON)) && c >= 'a' && c <= 'z')
+		c = kbmap_upper[sc];
+	return c;
+}
+
+/* Cooks raw scancodes until a line is finished or the ring runs dry */
+static void tty_cook(struct tty *tty)
+{
+	char c;
+
+	while(!tty->line_done && tty->raw_head != tty->raw_tail){
+		c = tty_translate(tty, tty->raw[tty->raw_head++ & (TTY_RAW_SIZE - 1)]);
+		if(!c)
+			continue;
+		if(c == 8){
+			if(tty->line_len){
+				tty->line_len--;
+				printk("\b \b");
+			}
+			continue;
+		}
+		tty->line[tty->line_len++] = c;
+		printk("%c", c);
+		if(c == '\n' || tty->line_len == TTY_LINE_MAX)
+			tty->line_done = 1;
+	}
+}
+
+/*
+ * Runs on every timer tick, see __wrap_handle_timer_tick. System calls
+ * run with interrupts off, so a reader that found no line is already
+ * parked on tty_wait by the time a tick can finish one.
+ */
+void tty_tick(void)
+{
+	struct tty *tty = &console;
+
+	tty_poll();
+	tty_cook(tty);
+	if(tty->line_done && tty_wait.waiters)
+		wake_up(&tty_wait);
+}
+
+/* Whether a finished line is waiting to be read */
+int tty_ready(void)
+{
+	struct tty *tty = &console;
+
+	tty_poll();
+	tty_cook(tty);
+	return tty->line_done;
+}
+
+/*
+ * Copies up to count bytes of the current line into buff. Returns 0
+ * while no line is finished, the caller decides whether to wait.
+ */
+int tty_read(char *buff, u32 count)
+{
+	struct tty *tty = &console;
+	u32 len;
+
+	if(!tty_ready())
+		return 0;
+	len = tty->line_len - tty->read_pos;
+	if(len > count)
+		len = count;
+	memcpy(buff, tty->line + tty->read_pos, len);
+	tty->read_pos += len;
+	if(tty->read_pos == tty->line_len){
+		tty->line_len = tty->read_pos = 0;
+		tty->line_done = 0;
+	}
+	return len;
+}
@@ -0,0 +1,35 @@
+#include<ulib.h>
+
+/*
+ * Counts how many times the file system read/write routines run per
+ * read() and write() on a regular file, using the per-inode counters
+ * from fsstats. Each call should copy the data exactly once.
+ */
+
+#define ITERATIONS 1000
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+	struct inode_stats ist;
+	char buf[512];
+	u32 cookie = 0;
+	int i;
+	int fd = open("rw_passes", O_CREAT|O_RDWR, O_READ|O_WRITE);
+
+	for(i = 0; i < 512; i++)
+		buf[i] = 'a' + i % 26;
+	for(i = 0; i < ITERATIONS; i++)
+		write(fd, buf, 512);
+	lseek(fd, 0, SEEK_SET);
+	for(i = 0; i < ITERATIONS; i++)
+		read(fd, buf, 512);
+
+	fsstats(NULL, &ist, 1, &cookie);
+	printf("write: %d copies per call, %d bytes per call\n", ist.writes / ITERATIONS,
+		(int)(ist.bytes_written / ITERATIONS));
+	printf("read: %d copies per call, %d bytes per call\n", ist.reads / ITERATIONS,
+		(int)(ist.bytes_read / ITERATIONS));
+	printf("file size %d (expected %d)\n", ist.file_size, 512 * ITERATIONS);
+	close(fd);
+	return 0;
+}
@@ -75,6 +75,7 @@ static long _syscall4(int syscall_num, u64 arg1, u64 arg2, u64 arg3, u64 arg4)
 
 void exit(int code)
 {
+	fflush();
 	_syscall1(SYSCALL_EXIT, code); 
 }
 
@@ -85,16 +86,19 @@ long getpid()
 
 long fork()
 {
+	fflush();
 	return(_syscall0(SYSCALL_FORK));
 }
 
 long cfork()
 {
+	fflush();
 	return(_syscall0(SYSCALL_CFORK));
 }
 
 long vfork()
 {
+	fflush();
 	return(_syscall0(SYSCALL_VFORK));
 }
 
@@ -184,6 +188,8 @@ int open(char * filename, int flags, ...)
 
 int read(int fd,void * buf, int count)
 {
+	if(fd == 0)
+		fflush();   // show the prompt before waiting for input
 	return _syscall3(SYSCALL_READ, fd, (u64)buf, count);
 }
 
@@ -222,6 +228,103 @@ int sendfile(int outfd, int infd, long *offset, int count)
 	return _syscall4(SYSCALL_SENDFILE, outfd, infd, (u64)offset, count);
 }
 
+int getdents(void *buf, int count, u32 *cookie)
+{
+	return _syscall3(SYSCALL_GETDENTS, (u64)buf, count, (u64)cookie);
+}
+
+int fclone(char *src, char *dst)
+{
+	return _syscall2(SYSCALL_FCLONE, (u64)src, (u64)dst);
+}
+
+long fdedup(int cmd)
+{
+	return _syscall1(SYSCALL_FDEDUP, cmd);
+}
+
+int fcompress(int cold_ticks, struct fcompress_stats *st)
+{
+	return _syscall2(SYSCALL_FCOMPRESS, cold_ticks, (u64)st);
+}
+
+int fsstats(struct fs_stats *st, struct inode_stats *buf, int count, u32 *cookie)
+{
+	return _syscall4(SYSCALL_FSSTATS, (u64)st, (u64)buf, count, (u64)cookie);
+}
+
+long readv(int fd, struct iovec *iov, int iovcnt)
+{
+	return _syscall3(SYSCALL_READV, fd, (u64)iov, iovcnt);
+}
+
+long writev(int fd, struct iovec *iov, int iovcnt)
+{
+	return _syscall3(SYSCALL_WRITEV, fd, (u64)iov, iovcnt);
+}
+
+int pread(int fd, void *buf, int count, long offset)
+{
+	return _syscall4(SYSCALL_PREAD, fd, (u64)buf, count, offset);
+}
+
+int pwrite(int fd, void *buf, int count, long offset)
+{
+	return _syscall4(SYSCALL_PWRITE, fd, (u64)buf, count, offset);
+}
+
+void *mmap_file(int fd, long offset, int length, int prot)
+{
+	return (void *)_syscall4(SYSCALL_MMAP_FILE, fd, offset, length, prot);
+}
+
+int splice(int fd_in, int fd_out, int len)
+{
+	return _syscall3(SYSCALL_SPLICE, fd_in, fd_out, len);
+}
+
+int tee(int fd_in, int fd_out, int len)
+{
+	return _syscall3(SYSCALL_TEE, fd_in, fd_out, len);
+}
+
+int io_setup(struct io_ring *ring, int flags)
+{
+	return _syscall2(SYSCALL_IO_SETUP, (u64)ring, flags);
+}
+
+int io_enter(int count)
+{
+	return _syscall1(SYSCALL_IO_ENTER, count);
+}
+
+/* Queues one operation, returns -1 when the submission ring is full */
+int io_queue(struct io_ring *ring, u32 opcode, int fd, u64 addr, u64 len, long off, u64 user_data)
+{
+	struct io_sqe *sqe;
+	if(ring->sq_tail - ring->sq_head == IO_RING_ENTRIES)
+		return -1;
+	sqe = &ring->sqes[ring->sq_tail % IO_RING_ENTRIES];
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->addr = addr;
+	sqe->len = len;
+	sqe->off = off;
+	sqe->user_data = user_data;
+	ring->sq_tail++;
+	return 0;
+}
+
+/* Takes the oldest completion, returns -1 when there is none */
+int io_reap(struct io_ring *ring, struct io_cqe *cqe)
+{
+	if(ring->cq_head == ring->cq_tail)
+		return -1;
+	*cqe = ring->cqes[ring->cq_head % IO_RING_ENTRIES];
+	ring->cq_head++;
+	return 0;
+}
+
 // message queue system call wrappers
 
 int create_msg_queue()
@@ -349,6 +452,65 @@ static void zero(char *ptr,int length){
 	for(i=0;i<length;++i) ptr[i] = 0;
 }
 
+/*
+ * stdout buffer. lib.o data is not loaded into the process, so the state
+ * lives in the first data segment page, which exec_init maps for every
+ * process and expand() never hands out. The page starts zeroed, which is
+ * an empty line buffered stream. fork copies it like any other page, so
+ * the fork wrappers flush first.
+ */
+#define USTDIO_ADDR 0x180000000UL
+#define USTDIO_BUF_SIZE (4096 - 2 * sizeof(int))
+
+struct ustdio{
+	int mode;
+	int len;
+	char buf[USTDIO_BUF_SIZE];
+};
+
+#define ustdout ((struct ustdio *)USTDIO_ADDR)
+
+int setvbuf(int mode)
+{
+	if(mode != _IOLBF && mode != _IOFBF && mode != _IONBF)
+		return -EINVAL;
+	fflush();
+	ustdout->mode = mode;
+	return 0;
+}
+
+int fflush(void)
+{
+	struct ustdio *out = ustdout;
+	int ret = 0;
+
+	if(out->len)
+		ret = write(1, out->buf, out->len);
+	out->len = 0;
+	return ret < 0 ? ret : 0;
+}
+
+static int stdout_put(char *buf, int count)
+{
+	struct ustdio *out = ustdout;
+	int i, newline = 0;
+
+	if(out->mode == _IONBF)
+		return write(1, buf, count);
+	if(out->len + count > USTDIO_BUF_SIZE)
+		fflush();
+	if(count > USTDIO_BUF_SIZE)
+		return write(1, buf, count);
+	for(i = 0; i < count; i++){
+		out->buf[out->len++] = buf[i];
+		if(buf[i] == '\n')
+			newline = 1;
+	}
+	if(newline && out->mode == _IOLBF)
+		fflush();
+	return count;
+}
+
 int printf(char *format,...)
 {
 	/*XXX TODO convert static*/
@@ -359,7 +521,7 @@ int printf(char *format,...)
 	va_start(args,format);
 	retval=vuprintf(buff,format,args);
 	va_end(args);
-	write(1, buff, retval);
+	stdout_put(buff, retval);
 	return retval;
 }
 
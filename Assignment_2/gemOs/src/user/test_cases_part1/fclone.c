@@ -0,0 +1,29 @@
+#include<ulib.h>
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+    char buf1[20];
+    char buf2[20];
+    int fd1 = open("orig.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+    int fd2;
+
+    write(fd1, "Hello, I am file!", 17);
+    printf("clone = %d\n", fclone("orig.txt", "copy.txt"));
+    printf("again = %d\n", fclone("orig.txt", "copy.txt"));
+
+    fd2 = open("copy.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+    write(fd2, "Bye", 3);
+
+    lseek(fd1, 0, SEEK_SET);
+    lseek(fd2, 0, SEEK_SET);
+    read(fd1, buf1, 17);
+    read(fd2, buf2, 17);
+    buf1[17] = '\0';
+    buf2[17] = '\0';
+    printf("buf1 = %s\n", buf1);
+    printf("buf2 = %s\n", buf2);
+
+    close(fd1);
+    close(fd2);
+    return 0;
+}
@@ -0,0 +1,29 @@
+#include<ulib.h>
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+    struct fcompress_stats st;
+    char page[4096];
+    char buf[20];
+    int i;
+    int fd = open("cold.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+
+    for(i = 0; i < 4096; i++)
+        page[i] = 'a' + i % 13;
+    for(i = 0; i < 8; i++)
+        write(fd, page, 4096);
+
+    printf("compressed = %d\n", fcompress(0, &st));
+    printf("pages = %d pool = %d\n", st.compressed_pages, st.pool_pages);
+    printf("ratio > 10 = %d\n", st.compressed_pages * 4096 > 10 * st.compressed_bytes);
+
+    lseek(fd, 4096 * 3, SEEK_SET);
+    read(fd, buf, 13);
+    buf[13] = '\0';
+    printf("buf = %s\n", buf);
+
+    fcompress(-1, &st);
+    printf("pages = %d decompressions = %d\n", st.compressed_pages, st.decompressions);
+    close(fd);
+    return 0;
+}
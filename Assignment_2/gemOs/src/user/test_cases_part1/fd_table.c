@@ -0,0 +1,25 @@
+#include<ulib.h>
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+    int i, fd, last = 0;
+    char buf[4];
+
+    fd = open("many.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+    write(fd, "xyz", 3);
+    for(i = 0; i < 200; i++)
+        last = open("many.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+    printf("last = %d\n", last);
+
+    printf("dup2 = %d\n", dup2(fd, 400));
+    lseek(fd, 0, SEEK_SET);
+    printf("read = %d\n", read(400, buf, 3));
+    printf("dup2 max = %d\n", dup2(fd, 512));
+
+    close(10);
+    close(100);
+    printf("lowest = %d\n", open("many.txt", O_CREAT|O_RDWR, O_READ|O_WRITE));
+    printf("next = %d\n", open("many.txt", O_CREAT|O_RDWR, O_READ|O_WRITE));
+    printf("closed = %d\n", close(100));
+    return 0;
+}
@@ -0,0 +1,31 @@
+#include<ulib.h>
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+    char page[4096];
+    int i, fd1, fd2;
+
+    for(i = 0; i < 4096; i++)
+        page[i] = 'a' + i % 26;
+
+    fd1 = open("template1.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+    fd2 = open("template2.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+    write(fd1, page, 4096);
+    write(fd1, page, 4096);
+    write(fd2, page, 4096);
+    printf("before = %d\n", fdedup(DEDUP_OFF));
+    printf("pass = %d\n", fdedup(DEDUP_RUN));
+
+    fdedup(DEDUP_ON);
+    write(fd2, page, 4096);
+    printf("write time = %d\n", fdedup(DEDUP_ON));
+
+    lseek(fd1, 0, SEEK_SET);
+    write(fd1, "X", 1);
+    printf("after write = %d\n", fdedup(DEDUP_OFF));
+    printf("bad cmd = %d\n", fdedup(7));
+
+    close(fd1);
+    close(fd2);
+    return 0;
+}
@@ -0,0 +1,33 @@
+#include<ulib.h>
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+    struct fs_stats st;
+    struct inode_stats ist[4];
+    char buf[20];
+    u32 cookie = 0;
+    int i, count;
+    int fd1 = open("hot.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+    int fd2 = open("cold.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+
+    write(fd1, "Hello, I am file!", 17);
+    for(i = 0; i < 3; i++){
+        lseek(fd1, 0, SEEK_SET);
+        read(fd1, buf, 17);
+    }
+    read(fd1, buf, 17);   // at the end of the file, not counted
+    write(fd2, "Bye", 3);
+    write(fd2, "Bye", 0);            // stores nothing, not counted
+    lseek(fd2, -1, SEEK_SET);        // rejected, not counted
+
+    count = fsstats(&st, ist, 4, &cookie);
+    printf("files = %d creates = %d count = %d\n", st.num_files, st.creates, count);
+    for(i = 0; i < count; i++)
+        printf("size %d reads %d writes %d seeks %d in %d out %d\n", ist[i].file_size, ist[i].reads,
+               ist[i].writes, ist[i].seeks, ist[i].bytes_written, ist[i].bytes_read);
+    printf("end = %d\n", fsstats(NULL, ist, 4, &cookie));
+
+    close(fd1);
+    close(fd2);
+    return 0;
+}
@@ -0,0 +1,35 @@
+#include<ulib.h>
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+    char filename[16] = "file_00.txt";
+    char buf[256];
+    u32 cookie = 0;
+    int i, fd, ret, calls = 0, files = 0, total_size = 0;
+
+    for(i = 0; i < 20; i++){
+        filename[5] = '0' + i / 10;
+        filename[6] = '0' + i % 10;
+        fd = open(filename, O_CREAT|O_RDWR, O_READ|O_WRITE);
+        write(fd, "Hello", i % 5 + 1);
+        close(fd);
+    }
+
+    while((ret = getdents(buf, 256, &cookie)) > 0){
+        int pos = 0;
+        calls++;
+        while(pos < ret){
+            struct dir_entry *dent = (struct dir_entry *)(buf + pos);
+            if(dent->name_len != 11)
+                printf("bad name %s\n", dent->name);
+            files++;
+            total_size += dent->file_size;
+            pos += dent->rec_len;
+        }
+    }
+    printf("files = %d size = %d\n", files, total_size);
+    printf("calls = %d\n", calls);
+    cookie = 0;
+    printf("small buffer = %d\n", getdents(buf, 8, &cookie));
+    return 0;
+}
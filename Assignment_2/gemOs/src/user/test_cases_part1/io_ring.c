@@ -0,0 +1,51 @@
+#include<ulib.h>
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+    struct io_ring ring;   // on the stack: test globals are not mapped in the process
+    struct io_cqe cqe;
+    struct io_ring *r;
+    char buf[16];
+    int fd, i, n = 0;
+
+    ring.sq_head = 0;   // fault the ring pages in before io_setup
+    ring.cqes[IO_RING_ENTRIES - 1].res = 0;
+    printf("enter = %d\n", io_enter(0));
+    printf("setup = %d\n", io_setup(&ring, 0));
+
+    io_queue(&ring, IO_OP_OPEN, 0, (u64)"ring.txt", O_CREAT|O_RDWR, O_READ|O_WRITE, 1);
+    printf("enter = %d\n", io_enter(0));
+    io_reap(&ring, &cqe);
+    fd = cqe.res;
+    printf("open = %d %d\n", cqe.user_data, fd);
+
+    for(i = 0; i < 10; i++)
+        io_queue(&ring, IO_OP_WRITE, fd, (u64)"0123456789" + i, 1, 0, 10 + i);
+    io_queue(&ring, IO_OP_LSEEK, fd, 0, SEEK_SET, 2, 20);
+    io_queue(&ring, IO_OP_READ, fd, (u64)buf, 5, 0, 21);
+    io_queue(&ring, IO_OP_WRITE, 99, (u64)buf, 1, 0, 22);
+    io_queue(&ring, IO_OP_CLOSE, fd, 0, 0, 0, 23);
+    printf("enter = %d\n", io_enter(0));
+    while(io_reap(&ring, &cqe) == 0){
+        if(cqe.user_data >= 20)
+            printf("cqe %d = %d\n", cqe.user_data, cqe.res);
+        else
+            n += cqe.res;
+    }
+    buf[5] = '\0';
+    printf("written = %d, buf = %s\n", n, buf);
+
+    for(i = 0; i < IO_RING_ENTRIES; i++)
+        io_queue(&ring, IO_OP_NOP, 0, 0, 0, 0, i);
+    printf("full = %d\n", io_queue(&ring, IO_OP_NOP, 0, 0, 0, 0, 0));
+    printf("enter = %d\n", io_enter(10));
+    printf("enter = %d\n", io_enter(0));
+
+    // a ring that is unmapped after io_setup is refused from then on
+    r = mmap(NULL, 4096, PROT_READ|PROT_WRITE, 0);
+    r->sq_head = 0;
+    printf("setup = %d\n", io_setup(r, 0));
+    munmap(r, 4096);
+    printf("enter = %d\n", io_enter(0));
+    return 0;
+}
@@ -0,0 +1,30 @@
+#include<ulib.h>
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+    struct io_ring ring;
+    struct io_cqe cqe;
+    char buf[16];
+    int fd, i, n = 0;
+    volatile u32 *done = &ring.cq_tail;
+
+    ring.sq_head = 0;   // fault the ring pages in before io_setup
+    ring.cqes[IO_RING_ENTRIES - 1].res = 0;
+    printf("setup = %d\n", io_setup(&ring, 2));
+    printf("setup = %d\n", io_setup(&ring, IO_SETUP_TICK));
+    fd = open("tick.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+
+    // no io_enter: the timer tick runs the queue while this loop spins
+    for(i = 0; i < 8; i++)
+        io_queue(&ring, IO_OP_PWRITE, fd, (u64)"abcdefgh" + i, 1, i, i);
+    while(*done != 8)
+        ;
+    while(io_reap(&ring, &cqe) == 0)
+        n += cqe.res;
+    printf("written = %d\n", n);
+    printf("read = %d\n", read(fd, buf, 8));
+    buf[8] = '\0';
+    printf("buf = %s\n", buf);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,25 @@
+#include<ulib.h>
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+    char buf[8];
+    char *map;
+    int fd = open("mapped.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+
+    write(fd, "hello, mapped file", 18);
+    map = mmap_file(fd, 0, 4096, PROT_READ|PROT_WRITE);
+    map[7] = 'M';
+    printf("map = %c%c%c%c\n", map[0], map[1], map[2], map[3]);
+
+    pread(fd, buf, 6, 7);
+    buf[6] = '\0';
+    printf("file = %s\n", buf);
+
+    pwrite(fd, "J", 1, 0);
+    printf("map[0] = %c\n", map[0]);
+    printf("unaligned = %d\n", (long)mmap_file(fd, 1, 4096, PROT_READ));
+    printf("past end = %d\n", (long)mmap_file(fd, 4096, 4096, PROT_READ));
+    munmap(map, 4096);
+    close(fd);
+    return 0;
+}
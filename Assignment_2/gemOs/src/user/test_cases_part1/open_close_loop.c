@@ -0,0 +1,23 @@
+#include<ulib.h>
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+    int i, fd, pfd[2], bad = 0;
+    char buf[4];
+
+    fd = open("loop.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+    write(fd, "abc", 3);
+    close(fd);
+    for(i = 0; i < 5000; i++){
+        fd = open("loop.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+        if(fd != 3 || read(fd, buf, 3) != 3 || buf[2] != 'c')
+            bad++;
+        close(fd);
+        pipe(pfd);
+        close(pfd[0]);
+        close(pfd[1]);
+    }
+    printf("bad = %d\n", bad);
+    printf("fd = %d\n", open("loop.txt", O_CREAT|O_RDWR, O_READ|O_WRITE));
+    return 0;
+}
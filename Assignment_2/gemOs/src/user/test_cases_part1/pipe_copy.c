@@ -0,0 +1,30 @@
+#include<ulib.h>
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+    char src[3000];
+    char dst[3000];
+    int p[2], i, diff;
+
+    for(i = 0; i < 3000; i++)
+        src[i] = 'a' + i % 23;
+    pipe(p);
+    printf("write = %d\n", write(p[1], src, 3000));
+    printf("read = %d\n", read(p[0], dst, 3000));
+    for(i = 0, diff = 0; i < 3000; i++)
+        diff += src[i] != dst[i];
+    printf("diff = %d\n", diff);
+
+    // runs past the end of the ring buffer and wraps to its start
+    for(i = 0; i < 3000; i++)
+        src[i] = 'A' + i % 19;
+    printf("write = %d\n", write(p[1], src, 2000));
+    printf("write = %d\n", write(p[1], src + 2000, 1000));
+    printf("read = %d\n", read(p[0], dst, 3000));
+    for(i = 0, diff = 0; i < 3000; i++)
+        diff += src[i] != dst[i];
+    printf("diff = %d\n", diff);
+    close(p[0]);
+    close(p[1]);
+    return 0;
+}
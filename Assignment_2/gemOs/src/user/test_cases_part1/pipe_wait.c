@@ -0,0 +1,32 @@
+#include<ulib.h>
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+    char big[4096];
+    char buf[32];
+    int p[2], q[2];
+
+    pipe(p);
+    pipe(q);
+    if(fork() == 0){
+        close(p[0]);
+        close(q[1]);
+        sleep(5);
+        write(p[1], "ping", 4);
+        read(q[0], big, 4096);
+        read(q[0], buf, 4);
+        exit(0);
+    }
+    close(p[1]);
+    close(q[0]);
+    // sleeps until the child writes, then reads what is there
+    printf("read = %d\n", read(p[0], buf, 32));
+    buf[4] = '\0';
+    printf("buf = %s\n", buf);
+    write(q[1], big, 4096);
+    // the pipe is full, sleeps until the child drains it
+    printf("write = %d\n", write(q[1], "more", 4));
+    // the child exits, closing the last write end
+    printf("eof = %d\n", read(p[0], buf, 32));
+    return 0;
+}
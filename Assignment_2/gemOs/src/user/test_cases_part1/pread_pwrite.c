@@ -0,0 +1,25 @@
+#include<ulib.h>
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+    char buf[8];
+    int pfd[2];
+    int fd = open("index.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+
+    write(fd, "0123456789", 10);
+    printf("pwrite = %d\n", pwrite(fd, "abc", 3, 4));
+    printf("offset = %d\n", lseek(fd, 0, SEEK_CUR));
+
+    printf("pread = %d\n", pread(fd, buf, 5, 2));
+    buf[5] = '\0';
+    printf("buf = %s\n", buf);
+    printf("offset = %d\n", lseek(fd, 0, SEEK_CUR));
+    printf("past end = %d\n", pread(fd, buf, 5, 100));
+    printf("negative = %d %d %d %d\n", read(fd, buf, -1), write(fd, buf, -1),
+           pread(fd, buf, -1, 0), pwrite(fd, buf, -1, 0));
+
+    pipe(pfd);
+    printf("pipe = %d\n", pread(pfd[0], buf, 1, 0));
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,51 @@
+#include<ulib.h>
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+    struct iovec iov[3];
+    char head[7];
+    char body[12];
+    int pfd[2];
+    int fd = open("record.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+
+    iov[0].iov_base = "HEADER";
+    iov[0].iov_len = 6;
+    iov[1].iov_base = "";
+    iov[1].iov_len = 0;
+    iov[2].iov_base = "payload-1234";
+    iov[2].iov_len = 11;
+    printf("writev = %d\n", writev(fd, iov, 3));
+
+    lseek(fd, 0, SEEK_SET);
+    iov[0].iov_base = head;
+    iov[0].iov_len = 6;
+    iov[1].iov_base = body;
+    iov[1].iov_len = 11;
+    printf("readv = %d\n", readv(fd, iov, 2));
+    head[6] = '\0';
+    body[11] = '\0';
+    printf("head = %s body = %s\n", head, body);
+
+    pipe(pfd);
+    iov[0].iov_base = "pipe ";
+    iov[0].iov_len = 5;
+    iov[1].iov_base = "data";
+    iov[1].iov_len = 4;
+    printf("pipe writev = %d\n", writev(pfd[1], iov, 2));
+    iov[0].iov_base = head;
+    iov[0].iov_len = 5;
+    iov[1].iov_base = body;
+    iov[1].iov_len = 4;
+    printf("pipe readv = %d\n", readv(pfd[0], iov, 2));
+    head[5] = '\0';
+    body[4] = '\0';
+    printf("%s%s\n", head, body);
+
+    iov[0].iov_base = "console ";
+    iov[0].iov_len = 8;
+    iov[1].iov_base = "writev\n";
+    iov[1].iov_len = 7;
+    writev(1, iov, 2);
+    close(fd);
+    return 0;
+}
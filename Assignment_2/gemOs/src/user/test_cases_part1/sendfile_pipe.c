@@ -0,0 +1,28 @@
+#include<ulib.h>
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+    char buf[16];
+    int pfd[2];
+    long off = 4096;
+    int src = open("big.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+    int dst = open("copy.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+
+    lseek(src, 3 * 4096 - 5, SEEK_SET);
+    write(src, "tail!", 5);
+    printf("file = %d\n", sendfile(dst, src, &off, 3 * 4096));
+    printf("off = %d\n", off);
+    printf("size = %d\n", lseek(dst, 0, SEEK_END));
+
+    pipe(pfd);
+    lseek(src, 3 * 4096 - 5, SEEK_SET);
+    printf("to pipe = %d\n", sendfile(pfd[1], src, NULL, 100));
+    printf("from pipe = %d\n", sendfile(dst, pfd[0], NULL, 100));
+    pread(dst, buf, 10, 2 * 4096 - 5);
+    buf[10] = '\0';
+    printf("buf = %s\n", buf);
+    printf("pipe to pipe = %d\n", sendfile(pfd[1], pfd[0], NULL, 1));
+    close(src);
+    close(dst);
+    return 0;
+}
@@ -0,0 +1,30 @@
+#include<ulib.h>
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+    char buf[16];
+    int i, zeros = 0;
+    int fd = open("sparse.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+
+    printf("%d\n", lseek(fd, 40960, SEEK_SET));
+    write(fd, "Hello", 5);
+    printf("%d\n", lseek(fd, 0, SEEK_END));
+
+    lseek(fd, 4096, SEEK_SET);
+    read(fd, buf, 16);
+    for(i = 0; i < 16; i++)
+        if(buf[i] == 0)
+            zeros++;
+    printf("zeros = %d\n", zeros);
+
+    printf("data = %d\n", lseek(fd, 0, SEEK_DATA));
+    printf("hole = %d\n", lseek(fd, 40960, SEEK_HOLE));
+    printf("past end = %d\n", lseek(fd, 40965, SEEK_DATA));
+
+    lseek(fd, 40960, SEEK_SET);
+    read(fd, buf, 5);
+    buf[5] = '\0';
+    printf("buf = %s\n", buf);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,34 @@
+#include<ulib.h>
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+    char buf[16];
+    int a[2], b[2];
+    int fd = open("log.txt", O_CREAT|O_RDWR, O_READ|O_WRITE);
+
+    pipe(a);
+    pipe(b);
+    write(a[1], "hello world", 11);
+    printf("tee = %d\n", tee(a[0], b[1], 5));
+    printf("to file = %d\n", splice(a[0], fd, 100));
+    read(b[0], buf, 5);
+    buf[5] = '\0';
+    printf("tee copy = %s\n", buf);
+
+    lseek(fd, 0, SEEK_SET);
+    printf("from file = %d\n", splice(fd, b[1], 6));
+    read(b[0], buf, 6);
+    buf[6] = '\0';
+    printf("buf = %s\n", buf);
+
+    write(a[1], "abc", 3);
+    printf("pipe = %d\n", splice(a[0], b[1], 10));
+    read(b[0], buf, 3);
+    buf[3] = '\0';
+    printf("moved = %s\n", buf);
+    close(a[1]);
+    printf("left = %d\n", read(a[0], buf, 1));
+    printf("file to file = %d\n", splice(fd, fd, 1));
+    close(fd);
+    return 0;
+}
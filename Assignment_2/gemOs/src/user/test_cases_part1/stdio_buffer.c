@@ -0,0 +1,29 @@
+#include<ulib.h>
+
+int main(u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5)
+{
+    char big[3000];
+    int i;
+
+    printf("line mode: ");
+    write(1, "[raw]", 5);
+    printf("flushed at newline\n");
+
+    setvbuf(_IOFBF);
+    for(i = 0; i < 200; i++)
+        printf("%d%s", i % 10, (i % 50 == 49) ? "\n" : "");
+    write(1, "[raw before flush]\n", 19);
+    fflush();
+
+    for(i = 0; i < 2999; i++)
+        big[i] = 'a' + (i / 1000);
+    big[2999] = '\n';
+    printf("console write = %d\n", write(1, big, 3000));
+
+    setvbuf(_IONBF);
+    printf("unbuffered ");
+    write(1, "[raw]\n", 6);
+    setvbuf(_IOFBF);
+    printf("left in the buffer, flushed by exit\n");
+    return 0;
+}
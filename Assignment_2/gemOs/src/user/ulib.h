@@ -52,6 +52,20 @@ typedef long long s64;
 #define SYSCALL_CLOSE       29
 #define SYSCALL_LSEEK       30
 #define SYSCALL_SENDFILE    38
+#define SYSCALL_GETDENTS    39
+#define SYSCALL_FCLONE      40
+#define SYSCALL_FDEDUP      41
+#define SYSCALL_FCOMPRESS   42
+#define SYSCALL_FSSTATS     43
+#define SYSCALL_READV       44
+#define SYSCALL_WRITEV      45
+#define SYSCALL_PREAD       46
+#define SYSCALL_PWRITE      47
+#define SYSCALL_MMAP_FILE   48
+#define SYSCALL_SPLICE      49
+#define SYSCALL_TEE         50
+#define SYSCALL_IO_SETUP    51
+#define SYSCALL_IO_ENTER    52
 
 // system call definitions for message queue
 #define SYSCALL_CREATE_MSG_QUEUE 31
@@ -62,6 +76,11 @@ typedef long long s64;
 #define SYSCALL_MSG_QUEUE_SEND 36
 #define SYSCALL_MSG_QUEUE_CLOSE 37
 
+// fdedup commands
+#define DEDUP_RUN 0
+#define DEDUP_ON  1
+#define DEDUP_OFF 2
+
 // constants for message queue
 #define MAX_MEMBERS 4
 
@@ -83,6 +102,11 @@ typedef long long s64;
 #define   O_EXEC  0x4
 #define   O_CREAT 0x8
 
+// stdout buffering modes for setvbuf(), line buffered by default
+#define _IOLBF 0
+#define _IOFBF 1
+#define _IONBF 2
+
 #define CREATE_READ O_READ
 #define CREATE_WRITE O_WRITE
 #define CREATE_EXEC O_EXEC
@@ -90,6 +114,8 @@ enum{
       SEEK_SET,
       SEEK_CUR,
       SEEK_END,
+      SEEK_DATA,   // next offset backed by data
+      SEEK_HOLE,   // next offset inside a hole (or EOF)
       MAX_SEEK,
 };
 
@@ -123,6 +149,104 @@ struct os_configs{
 	u64 adv_global; 
 };
 
+/* One buffer of a readv/writev call */
+struct iovec{
+	void *iov_base;
+	u64 iov_len;
+};
+#define MAX_IOVEC 64
+
+/*
+ * Submission/completion ring shared by a process and the kernel, see
+ * io_setup and io_enter. The process fills sqes[sq_tail % IO_RING_ENTRIES]
+ * and bumps sq_tail; io_enter runs the queued operations from sq_head on
+ * and posts one cqe each, bumping cq_tail. The process reaps cqes from
+ * cq_head. Heads and tails only grow. A ring set up with IO_SETUP_TICK
+ * is also drained at each timer tick that finds the process running, so
+ * it can submit without any system call.
+ */
+#define IO_RING_ENTRIES 64
+#define IO_SETUP_TICK 1
+
+enum{
+	IO_OP_NOP,
+	IO_OP_READ,        // fd, addr = buffer, len = count
+	IO_OP_WRITE,       // fd, addr = buffer, len = count
+	IO_OP_LSEEK,       // fd, off = offset, len = whence
+	IO_OP_OPEN,        // addr = filename, len = flags, off = mode
+	IO_OP_CLOSE,       // fd
+	IO_OP_PREAD,       // fd, addr = buffer, len = count, off = offset
+	IO_OP_PWRITE,      // fd, addr = buffer, len = count, off = offset
+	IO_OP_MSG_SEND,    // fd, addr = message
+	IO_OP_MSG_RCV,     // fd, addr = message
+	MAX_IO_OP,
+};
+
+struct io_sqe{
+	u32 opcode;
+	int fd;
+	u64 addr;
+	u64 len;
+	long off;
+	u64 user_data;     // copied to the cqe
+};
+
+struct io_cqe{
+	u64 user_data;
+	long res;          // what the system call would have returned
+};
+
+struct io_ring{
+	u32 sq_head;
+	u32 sq_tail;
+	u32 cq_head;
+	u32 cq_tail;
+	struct io_sqe sqes[IO_RING_ENTRIES];
+	struct io_cqe cqes[IO_RING_ENTRIES];
+};
+
+/* Record returned by getdents, rec_len apart */
+struct dir_entry{
+	u32 inode_no;
+	u32 file_size;
+	u32 mode;
+	u16 rec_len;
+	u16 name_len;
+	char name[];
+};
+
+/* fsstats: file system wide counters */
+struct fs_stats{
+	u64 num_files;
+	u64 lookups;
+	u64 creates;
+	u64 removes;
+	u64 hash_collisions;      // creates that landed in a used name bucket
+	u64 shared_bytes;         // bytes saved by shared store pages
+	u64 dedup_merges;
+};
+
+/* fsstats: counters of one file */
+struct inode_stats{
+	u32 inode_no;
+	u32 file_size;
+	u32 reads;
+	u32 writes;
+	u32 opens;
+	u32 seeks;
+	u64 bytes_read;
+	u64 bytes_written;
+};
+
+/* filled in by fcompress */
+struct fcompress_stats{
+	u64 compressed_pages;     // file pages held compressed
+	u64 compressed_bytes;     // bytes they take in the pool
+	u64 pool_pages;           // store pages used by the pool
+	u64 decompressions;
+	u64 decompress_cycles;    // total rdtsc cycles spent decompressing
+};
+
 struct msg_queue_member_info{
 	u32 member_count;
 	u32 member_pid[MAX_MEMBERS];
@@ -155,6 +279,8 @@ extern long clone(void (func)(void), long stack_addr);
 extern long dump_page_table(char *address);
 extern long physinfo();
 extern int printf(char *format,...);
+extern int setvbuf(int mode);
+extern int fflush(void);
 extern void* mmap(void *addr, int length, int prot, int flags);
 extern int munmap(void *addr, int length);
 extern int mprotect(void *addr, int length, int prot);
@@ -172,6 +298,22 @@ extern int close(int fd);
 extern long lseek(int fd, long offset, int whence);
 extern int ustrcmp(char * s, char * d);
 extern int sendfile(int outfd, int infd, long *offset, int count);
+extern int getdents(void *buf, int count, u32 *cookie);
+extern int fclone(char *src, char *dst);
+extern long fdedup(int cmd);
+extern int fcompress(int cold_ticks, struct fcompress_stats *st);
+extern int fsstats(struct fs_stats *st, struct inode_stats *buf, int count, u32 *cookie);
+extern long readv(int fd, struct iovec *iov, int iovcnt);
+extern long writev(int fd, struct iovec *iov, int iovcnt);
+extern int pread(int fd, void *buf, int count, long offset);
+extern int pwrite(int fd, void *buf, int count, long offset);
+extern void *mmap_file(int fd, long offset, int length, int prot);
+extern int splice(int fd_in, int fd_out, int len);
+extern int tee(int fd_in, int fd_out, int len);
+extern int io_setup(struct io_ring *ring, int flags);
+extern int io_enter(int count);
+extern int io_queue(struct io_ring *ring, u32 opcode, int fd, u64 addr, u64 len, long off, u64 user_data);
+extern int io_reap(struct io_ring *ring, struct io_cqe *cqe);
 
 // system call signatures for message queue
 extern int create_msg_queue();
@@ -0,0 +1,54 @@
+#include<types.h>
+#include<context.h>
+#include<entry.h>
+#include<schedule.h>
+#include<wait.h>
+
+/*
+ * The queue each pid is parked on. A woken waiter runs its system call
+ * again, and the wait check clears this before anything else, so a stale
+ * bit left in some queue (woken by the timer, or the pid reused) never
+ * wakes it from another sleep.
+ */
+static struct wait_queue *waiting_on[MAX_PROCESSES];
+
+/*
+ * Parks the current context on wq and does not return: the syscall is
+ * rewound to its int 0x80 (two bytes) and the next context is scheduled.
+ * ticks > 0 also wakes it from the timer, for producers that can only be
+ * polled.
+ */
+void wait_event(struct wait_queue *wq, u32 ticks)
+{
+	struct exec_context *current = get_current_ctx();
+
+	wq->waiters |= 1 << current->pid;
+	waiting_on[current->pid] = wq;
+	current->regs.entry_rip -= 2;
+	do_sleep(ticks);
+}
+
+void wake_up(struct wait_queue *wq)
+{
+	struct exec_context *ctx;
+	u32 pid;
+
+	for(pid = 0; wq->waiters && pid < MAX_PROCESSES; pid++){
+		if(!(wq->waiters & (1 << pid)))
+			continue;
+		wq->waiters &= ~(1 << pid);
+		if(waiting_on[pid] != wq)
+			continue;
+		waiting_on[pid] = NULL;
+		ctx = get_ctx_by_pid(pid);
+		if(ctx->state == WAITING){
+			ctx->ticks_to_sleep = 0;
+			ctx->state = READY;
+		}
+	}
+}
+
+void wait_clear(struct exec_context *ctx)
+{
+	waiting_on[ctx->pid] = NULL;
+}